@@ -0,0 +1,105 @@
+// CImg plugin with contour tracing
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+/*
+ * Polygons of the 4-connected components of the pixels with value val
+ * (see label4()) along the pixel edges.  Every boundary is followed once
+ * keeping the component on the left, at corners touching two diagonal
+ * component pixels the boundary turns so the pixels stay separate.  Outer
+ * rings are clockwise in pixel coordinates (y down), holes counterclockwise.
+ * polys[i] belongs to component i+1 of label4(), the outer ring comes first.
+ * Returns the number of polygons.
+ */
+
+size_t trace_polygons(const T val, std::vector<ContourPolygon> &polys) const
+{
+	const int xsize = width();
+	const int ysize = height();
+
+	CImg<unsigned int> labels;
+	std::vector<ComponentStats> stats;
+	const size_t n = label4(val, labels, stats);
+
+	polys.clear();
+	polys.resize(n);
+
+	// visited horizontal edges, edge (x,y) is the upper edge of pixel (x,y)
+	std::vector<bool> visited((size_t)xsize*(ysize+1), false);
+
+	// directions east, south, west, north
+	const int dx[4] = { 1, 0, -1, 0 };
+	const int dy[4] = { 0, 1, 0, -1 };
+
+	for (int y = 0; y <= ysize; y++)
+		for (int x = 0; x < xsize; x++)
+		{
+			const bool above = (y > 0) && ((*this)(x,y-1) == val);
+			const bool below = (y < ysize) && ((*this)(x,y) == val);
+			if ((above == below) || visited[(size_t)y*xsize + x])
+				continue;
+
+			// the component is on the left: going west with it below and
+			// east with it above
+			const int d0 = below ? 2 : 0;
+			const int sx = below ? x+1 : x;
+			const int sy = y;
+			const unsigned int label = below ? labels(x,y) : labels(x,y-1);
+
+			std::vector<int> ring;
+			int vx = sx, vy = sy, d = d0;
+			for (;;)
+			{
+				if (d == 0) visited[(size_t)vy*xsize + vx] = true;
+				else if (d == 2) visited[(size_t)vy*xsize + vx-1] = true;
+				vx += dx[d];
+				vy += dy[d];
+
+				// the pixels ahead left and right of the vertex
+				int lx, ly, rx, ry;
+				switch (d)
+				{
+					case 0: lx = vx; ly = vy-1; rx = vx; ry = vy; break;
+					case 1: lx = vx; ly = vy; rx = vx-1; ry = vy; break;
+					case 2: lx = vx-1; ly = vy; rx = vx-1; ry = vy-1; break;
+					default: lx = vx-1; ly = vy-1; rx = vx; ry = vy-1; break;
+				}
+				const bool left = (lx >= 0) && (ly >= 0) && (lx < xsize) && (ly < ysize) && ((*this)(lx,ly) == val);
+				const bool right = (rx >= 0) && (ry >= 0) && (rx < xsize) && (ry < ysize) && ((*this)(rx,ry) == val);
+
+				int nd = d;
+				if (!left) nd = (d+3) & 3;
+				else if (right) nd = (d+1) & 3;
+
+				if (nd != d)
+				{
+					ring.push_back(vx);
+					ring.push_back(vy);
+				}
+
+				d = nd;
+				if ((vx == sx) && (vy == sy) && (d == d0))
+					break;
+			}
+
+			if (label == 0) continue;
+
+			// twice the signed area (shoelace formula), negative for outer rings
+			long long area2 = 0;
+			const size_t nv = ring.size()/2;
+			for (size_t i = 0; i < nv; i++)
+			{
+				const size_t j = (i+1) % nv;
+				area2 += (long long)ring[2*i]*ring[2*j+1] - (long long)ring[2*j]*ring[2*i+1];
+			}
+
+			std::vector< std::vector<int> > &rings = polys[label-1].rings;
+			if (area2 < 0)
+				rings.insert(rings.begin(), std::vector<int>());
+			else
+				rings.push_back(std::vector<int>());
+			(area2 < 0 ? rings.front() : rings.back()).swap(ring);
+		}
+
+	return n;
+}
@@ -0,0 +1,147 @@
+// CImg plugin with exact Euclidean distance and feature transforms
+// Copyright 2012 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+/*
+ * Separable exact Euclidean distance transform after
+ * A. Meijster, J.B.T.M. Roerdink, W.H. Hesselink: "A General Algorithm for
+ * Computing Distance Transforms in Linear Time", 2000.
+ *
+ * The first pass finds the nearest feature pixel (pixels with value val) in
+ * every column, the second one the lower envelope of the resulting
+ * parabolas along every row.  Besides the distances the position of the
+ * nearest feature pixel is tracked.  The column pass runs on strips of
+ * DISTANCE_STRIP columns swept row by row, the strips and the rows of the
+ * second pass are processed in parallel.
+ */
+
+const static int DISTANCE_STRIP = 64;
+
+/* Feature transform: index (x + y*width) of the nearest pixel with value */
+/* val or -1 if there is none.  If dist2 is given it receives the squared */
+/* distances (saturated at UINT_MAX, also for pixels without feature).     */
+/* ft and dist2 keep their memory if they already have the right size.    */
+
+void feature_transform(const T val, CImg<int> &ft, CImg<unsigned int> *dist2 = NULL) const
+{
+	const int xsize = width();
+	const int ysize = height();
+	const long long inf = (long long)xsize + ysize;
+
+	ft.assign(xsize, ysize, 1, 1);
+	if (dist2 != NULL)
+		dist2->assign(xsize, ysize, 1, 1);
+
+	// nearest feature row in every column
+	const int nstrips = (xsize+DISTANCE_STRIP-1)/DISTANCE_STRIP;
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < nstrips; i++)
+	{
+		const int x0 = i*DISTANCE_STRIP;
+		const int x1 = std::min(x0+DISTANCE_STRIP, xsize);
+		int last[DISTANCE_STRIP];
+		std::fill(last, last+DISTANCE_STRIP, -1);
+		for (int y = 0; y < ysize; y++)
+			for (int x = x0; x < x1; x++)
+			{
+				if ((*this)(x,y) == val) last[x-x0] = y;
+				ft(x,y) = last[x-x0];
+			}
+		int *next = last;
+		std::fill(next, next+DISTANCE_STRIP, -1);
+		for (int y = ysize-1; y >= 0; y--)
+			for (int x = x0; x < x1; x++)
+			{
+				if ((*this)(x,y) == val) next[x-x0] = y;
+				const int n = next[x-x0];
+				if (n >= 0)
+					if ((ft(x,y) < 0) || (n-y < y-ft(x,y)))
+						ft(x,y) = n;
+			}
+	}
+
+#pragma omp parallel
+	{
+		std::vector<int> row(xsize);
+		std::vector<long long> g(xsize);
+		std::vector<int> s(xsize);
+		std::vector<int> t(xsize);
+
+#pragma omp for schedule(dynamic,16)
+		for (int y = 0; y < ysize; y++)
+		{
+			for (int x = 0; x < xsize; x++)
+			{
+				row[x] = ft(x,y);
+				g[x] = (row[x] < 0) ? inf : std::abs(y-row[x]);
+			}
+
+			// lower envelope of the parabolas (x-i)^2 + g(i)^2
+			int q = 0;
+			s[0] = 0;
+			t[0] = 0;
+			for (int u = 1; u < xsize; u++)
+			{
+				while ((q >= 0) &&
+				       ((long long)(t[q]-s[q])*(t[q]-s[q]) + g[s[q]]*g[s[q]] > (long long)(t[q]-u)*(t[q]-u) + g[u]*g[u]))
+					q--;
+				if (q < 0)
+				{
+					q = 0;
+					s[0] = u;
+				}
+				else
+				{
+					// first x at which parabola u is below parabola s[q]
+					const long long num = (long long)u*u - (long long)s[q]*s[q] + g[u]*g[u] - g[s[q]]*g[s[q]];
+					const long long den = 2*(long long)(u-s[q]);
+					const long long sep = (num >= 0) ? num/den : -((-num+den-1)/den);
+					if (sep+1 < xsize)
+					{
+						q++;
+						s[q] = u;
+						t[q] = sep+1;
+					}
+				}
+			}
+
+			for (int u = xsize-1; u >= 0; u--)
+			{
+				const int i = s[q];
+				if (row[i] < 0)
+					ft(u,y) = -1;
+				else
+					ft(u,y) = i + row[i]*xsize;
+				if (dist2 != NULL)
+				{
+					const long long d2 = (long long)(u-i)*(u-i) + g[i]*g[i];
+					(*dist2)(u,y) = (row[i] < 0) ? UINT_MAX : (unsigned int)std::min(d2, (long long)UINT_MAX);
+				}
+				if (u == t[q]) q--;
+			}
+		}
+	}
+}
+
+CImg<int> get_feature_transform(const T val, CImg<unsigned int> *dist2 = NULL) const
+{
+	CImg<int> ft;
+	feature_transform(val, ft, dist2);
+	return ft;
+}
+
+/* Squared Euclidean distance to the nearest pixel with value val, ft is	*/
+/* scratch space for the feature transform.				*/
+
+void distance2(const T val, CImg<unsigned int> &dist2, CImg<int> &ft) const
+{
+	feature_transform(val, ft, &dist2);
+}
+
+CImg<unsigned int> get_distance2(const T val) const
+{
+	CImg<unsigned int> dist2;
+	CImg<int> ft;
+	distance2(val, dist2, ft);
+	return dist2;
+}
@@ -0,0 +1,119 @@
+// CImg plugin with connected component labeling
+// Copyright 2012 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+/*
+ * Two pass union find labeling of the 4-connected components of all pixels
+ * with value val.  The first pass assigns provisional labels and records
+ * their equivalences separately for bands of rows which are processed in
+ * parallel, the bands are then joined along their borders and the second
+ * pass writes the final labels and collects the component statistics.
+ *
+ * Components are numbered from 1 in the order of their first pixel in scan
+ * order, other pixels get label 0.  stats[i] holds area and bounding box
+ * of component i (stats[0] is unused).  Returns the number of components.
+ */
+
+size_t label4(const T val, CImg<unsigned int> &labels, std::vector<ComponentStats> &stats) const
+{
+	const int xsize = width();
+	const int ysize = height();
+	int nb = 1;
+
+#ifdef _OPENMP
+	nb = std::max(1, std::min(omp_get_max_threads(), ysize/16));
+#endif
+
+	labels.assign(xsize, ysize, 1, 1);
+
+	// provisional labels and their equivalences per band, local label 0 is background
+	std::vector< std::vector<unsigned int> > parents(nb);
+
+#pragma omp parallel for if (nb > 1)
+	for (int b = 0; b < nb; b++)
+	{
+		const int y0 = (b*ysize)/nb;
+		const int y1 = ((b+1)*ysize)/nb;
+		std::vector<unsigned int> &parent = parents[b];
+		parent.push_back(0);
+
+		for (int y = y0; y < y1; y++)
+			for (int x = 0; x < xsize; x++)
+			{
+				if ((*this)(x,y) != val)
+				{
+					labels(x,y) = 0;
+					continue;
+				}
+				const unsigned int up = (y > y0) ? labels(x,y-1) : 0;
+				const unsigned int left = (x > 0) ? labels(x-1,y) : 0;
+				if (up && left)
+				{
+					uf_union(parent, up, left);
+					labels(x,y) = std::min(up, left);
+				}
+				else if (up || left)
+					labels(x,y) = up + left;
+				else
+				{
+					labels(x,y) = parent.size();
+					parent.push_back(parent.size());
+				}
+			}
+	}
+
+	// join bands into global provisional labels
+	std::vector<unsigned int> base(nb+1);
+	base[0] = 0;
+	for (int b = 0; b < nb; b++)
+		base[b+1] = base[b] + parents[b].size() - 1;
+
+	std::vector<unsigned int> parent(base[nb]+1);
+	parent[0] = 0;
+	for (int b = 0; b < nb; b++)
+	{
+		for (unsigned int l = 1; l < parents[b].size(); l++)
+			parent[base[b]+l] = base[b] + uf_find(parents[b], l);
+		std::vector<unsigned int>().swap(parents[b]);
+	}
+
+	for (int b = 1; b < nb; b++)
+	{
+		const int y = (b*ysize)/nb;
+		for (int x = 0; x < xsize; x++)
+			if (labels(x,y-1) && labels(x,y))
+				uf_union(parent, base[b-1]+labels(x,y-1), base[b]+labels(x,y));
+	}
+
+	// final labels in order of the first pixel
+	for (unsigned int l = 1; l < parent.size(); l++)
+		parent[l] = uf_find(parent, l);
+
+	unsigned int n = 0;
+	for (unsigned int l = 1; l < parent.size(); l++)
+		parent[l] = (parent[l] == l) ? ++n : parent[parent[l]];
+
+	std::vector<ComponentStats> pstats(parent.size());
+
+#pragma omp parallel for if (nb > 1)
+	for (int b = 0; b < nb; b++)
+	{
+		const int y0 = (b*ysize)/nb;
+		const int y1 = ((b+1)*ysize)/nb;
+
+		for (int y = y0; y < y1; y++)
+			for (int x = 0; x < xsize; x++)
+				if (labels(x,y))
+				{
+					const unsigned int l = base[b]+labels(x,y);
+					pstats[l].add(x,y);
+					labels(x,y) = parent[l];
+				}
+	}
+
+	stats.assign(n+1, ComponentStats());
+	for (unsigned int l = 1; l < parent.size(); l++)
+		stats[parent[l]].add(pstats[l]);
+
+	return n;
+}
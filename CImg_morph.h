@@ -0,0 +1,142 @@
+// CImg plugin for binary disk and square morphology
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+/*
+ * Disk erosion and dilation threshold the exact squared distance transform
+ * from CImg_distance.h, so their cost does not depend on the radius.  The
+ * disk contains all offsets (dx,dy) with sqrt(dx*dx+dy*dy) <= r, which is
+ * the structuring element otherwise built as a dense mask for erode() and
+ * dilate().  Pixels are set when nonzero and the results are 0/255.  Points
+ * outside the image are ignored - for a disk centered in the image this is
+ * the same as the Neumann boundary of the mask based CImg functions.
+ *
+ * Square erosion uses the van Herk/Gil-Werman algorithm: with the lines
+ * split into blocks of the window size a window minimum is the minimum of
+ * one suffix and one prefix minimum, independent of the size.
+ */
+
+/* Largest squared distance inside a disk of radius r.			*/
+
+static unsigned int disk_radius2(const float r)
+{
+	if (!(r > 0)) return 0;
+	unsigned int n = (unsigned int)((double)r*r);
+	while (std::sqrt((double)(n+1)) <= r) n++;
+	while ((n > 0) && (std::sqrt((double)n) > r)) n--;
+	return n;
+}
+
+/* Erosion by thresholding dist2, the squared distance transform of the	*/
+/* zero pixels of this image computed by the caller.			*/
+
+CImg<T>& erode_disk(const float r, const CImg<unsigned int> &dist2)
+{
+	const unsigned int n = disk_radius2(r);
+	cimg_forXY(*this,x,y)
+		(*this)(x,y) = (dist2(x,y) <= n) ? 0 : 255;
+	return *this;
+}
+
+/* Erosion and dilation with caller provided buffers: dist2 receives the	*/
+/* distance field and ft is scratch space, both keep their memory if	*/
+/* they already have the right size.					*/
+
+CImg<T>& erode_disk(const float r, CImg<unsigned int> &dist2, CImg<int> &ft)
+{
+	distance2(0, dist2, ft);
+	return erode_disk(r, (const CImg<unsigned int> &)dist2);
+}
+
+CImg<T>& dilate_disk(const float r, CImg<unsigned int> &dist2, CImg<int> &ft)
+{
+	// distance to the set pixels = distance to the zeros of the complement
+	cimg_forXY(*this,x,y)
+		(*this)(x,y) = ((*this)(x,y) != 0) ? 0 : 255;
+	distance2(0, dist2, ft);
+	const unsigned int n = disk_radius2(r);
+	cimg_forXY(*this,x,y)
+		(*this)(x,y) = (dist2(x,y) <= n) ? 255 : 0;
+	return *this;
+}
+
+CImg<T>& erode_disk(const float r)
+{
+	CImg<unsigned int> dist2;
+	CImg<int> ft;
+	return erode_disk(r, dist2, ft);
+}
+
+CImg<T> get_erode_disk(const float r) const
+{
+	return (+*this).erode_disk(r);
+}
+
+CImg<T>& dilate_disk(const float r)
+{
+	CImg<unsigned int> dist2;
+	CImg<int> ft;
+	return dilate_disk(r, dist2, ft);
+}
+
+CImg<T> get_dilate_disk(const float r) const
+{
+	return (+*this).dilate_disk(r);
+}
+
+/* Minimum over the window [i-(s-s/2-1), i+s/2] of every line element,	*/
+/* same window placement as CImg erode(s).  Elements outside the line	*/
+/* are ignored.  g and h are scratch arrays of size len+s-1.		*/
+
+static void erode_line(T *line, const int len, const long off, const int s, T *g, T *h)
+{
+	const int lo = s - s/2 - 1;
+	const int n = len + s - 1;
+	const T tmax = cimg::type<T>::max();
+
+	// padded line p(i) = line(i-lo), prefix minima in blocks of size s
+	for (int i = 0; i < n; i++)
+	{
+		const int k = i - lo;
+		const T v = ((k >= 0) && (k < len)) ? line[k*off] : tmax;
+		g[i] = ((i % s) == 0) ? v : std::min(g[i-1], v);
+	}
+	// suffix minima in the same blocks
+	for (int i = n-1; i >= 0; i--)
+	{
+		const int k = i - lo;
+		const T v = ((k >= 0) && (k < len)) ? line[k*off] : tmax;
+		h[i] = ((((i+1) % s) == 0) || (i == n-1)) ? v : std::min(h[i+1], v);
+	}
+	for (int i = 0; i < len; i++)
+		line[i*off] = std::min(h[i], g[i+s-1]);
+}
+
+CImg<T>& erode_square(const unsigned int s)
+{
+	if ((s <= 1) || is_empty()) return *this;
+
+	const int xsize = width();
+	const int ysize = height();
+
+#pragma omp parallel
+	{
+		std::vector<T> g(std::max(xsize, ysize) + s);
+		std::vector<T> h(std::max(xsize, ysize) + s);
+
+#pragma omp for schedule(static)
+		for (int y = 0; y < ysize; y++)
+			erode_line(data(0,y), xsize, 1, s, &g[0], &h[0]);
+
+#pragma omp for schedule(static)
+		for (int x = 0; x < xsize; x++)
+			erode_line(data(x,0), ysize, xsize, s, &g[0], &h[0]);
+	}
+
+	return *this;
+}
+
+CImg<T> get_erode_square(const unsigned int s) const
+{
+	return (+*this).erode_square(s);
+}
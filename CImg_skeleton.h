@@ -50,6 +50,12 @@ struct Point {
 /*	On Entry:							*/
 /*	    image = Image to thin.					*/
 /*									*/
+/*	Each directional sub pass only depends on the image state at	*/
+/*	its start so the image is split into row bands processed	*/
+/*	concurrently.  The rows adjacent to the band limits are saved	*/
+/*	before every sub pass which gives results identical to the	*/
+/*	serial scan.							*/
+/*									*/
 /* -------------------------------------------------------------------- */
 
 size_t thin(const T threshold, bool Progress = false)
@@ -58,67 +64,50 @@ size_t thin(const T threshold, bool Progress = false)
 	int pc	= 0;      /* Pass count			*/
 	size_t count = 1;	/* Deleted pixel count		*/
 	size_t tcount = 0;
-	int p, q;         /* Neighborhood maps of adjacent cells */
-	int m;            /* Deletion direction mask	*/
+	int nb = 1;       /* Number of row bands	*/
 
 	xsize = width();
 	ysize = height();
 
-	CImg<unsigned char> qb = CImg<unsigned char>(xsize,1,1,1);
-	qb(xsize-1) = 0;		/* Used for lower-right pixel	*/
+#ifdef _OPENMP
+	nb = std::max(1, std::min(omp_get_max_threads(), ysize/16));
+#endif
+
+	/* First and last row of every band as of the start of the sub pass */
+	CImg<unsigned char> edges = CImg<unsigned char>(xsize,2*nb,1,1);
 
 	while ( count ) {		/* Scan image while deletions	*/
 		pc++;
 		count = 0;
 		for (int i=0; i<4; i++) {
-			m = masks[i];
-			/* Build initial previous scan buffer.			*/
-			p = (*this)(0,0) != 0;
-			for (int x = 0 ; x < xsize-1 ; x++ )
-		    qb(x) = p = ((p<<1)&0006) | ((*this)(x+1,0) != 0);
-
-			/* Scan image for pixel deletion candidates.		*/
-
-			for (int y = 0 ; y < ysize-1 ; y++ ) {
-		    q = qb(0);
-		    p = ((q<<3)&0110) | ((*this)(0,y+1) != 0);
-
-		    for (int x = 0 ; x < xsize-1 ; x++ ) {
-					q = qb(x);
-					p = ((p<<1)&0666) | ((q<<3)&0110) | ((*this)(x+1,y+1) != 0);
-					qb(x) = p;
-					if  ( ((p&m) == 0) && xdelete[p] ) {
-						if ((*this)(x,y) < threshold)
-						{
-							count++;
-							(*this)(x,y) = 0;
-						}
-					}
-		    }
+			const int m = masks[i]; /* Deletion direction mask */
 
-		    /* Process right edge pixel.			*/
-		    p = (p<<1)&0666;
-		    if	( (p&m) == 0 && xdelete[p] ) {
-					if ((*this)(xsize-1,y) < threshold)
+			if (nb > 1)
+			{
+#pragma omp parallel for
+				for (int b = 0; b < nb; b++)
+				{
+					const int y0 = (b*ysize)/nb;
+					const int y1 = ((b+1)*ysize)/nb;
+					for (int x = 0 ; x < xsize ; x++ )
 					{
-						count++;
-						(*this)(xsize-1,y) = 0;
+						edges(x,2*b) = (*this)(x,y0) != 0;
+						edges(x,2*b+1) = (*this)(x,y1-1) != 0;
 					}
-		    }
+				}
 			}
 
-			/* Process bottom scan line.				*/
-			for (int x = 0 ; x < xsize ; x++ ) {
-		    q = qb(x);
-		    p = ((p<<1)&0666) | ((q<<3)&0110);
-		    if	( (p&m) == 0 && xdelete[p] ) {
-					if ((*this)(x,ysize-1) < threshold)
-					{
-						count++;
-						(*this)(x,ysize-1) = 0;
-					}
-		    }
+			size_t bcount = 0;
+#pragma omp parallel for reduction(+:bcount) if (nb > 1)
+			for (int b = 0; b < nb; b++)
+			{
+				const int y0 = (b*ysize)/nb;
+				const int y1 = ((b+1)*ysize)/nb;
+				bcount += thin_band(threshold, m, y0, y1,
+				                    (b > 0) ? edges.data(0,2*b-1) : NULL,
+				                    (b < nb-1) ? edges.data(0,2*b+2) : NULL);
 			}
+			count += bcount;
 		}
 
 		if (Progress)
@@ -128,6 +117,193 @@ size_t thin(const T threshold, bool Progress = false)
 	return tcount;
 }
 
+/*	One directional sub pass of thin() on rows y0 to y1-1.  above	*/
+/*	and below are the rows next to the band as of the start of the	*/
+/*	sub pass or NULL at the image border.				*/
+
+size_t thin_band(const T threshold, const int m, const int y0, const int y1,
+                 const unsigned char *above, const unsigned char *below)
+{
+	const int xsize = width();
+	const int ysize = height();
+	size_t count = 0;
+	int p = 0, q;         /* Neighborhood maps of adjacent cells */
+
+	CImg<unsigned char> qb = CImg<unsigned char>(xsize,1,1,1);
+	qb(xsize-1) = 0;		/* Used for lower-right pixel	*/
+
+	if (above == NULL)
+	{
+		/* Build initial previous scan buffer.			*/
+		p = (*this)(0,y0) != 0;
+		for (int x = 0 ; x < xsize-1 ; x++ )
+			qb(x) = p = ((p<<1)&0006) | ((*this)(x+1,y0) != 0);
+	}
+	else
+	{
+		/* Right column of the previous row's maps.		*/
+		for (int x = 0 ; x < xsize-1 ; x++ )
+			qb(x) = ((above[x+1] != 0)<<3) | ((*this)(x+1,y0) != 0);
+	}
+
+	/* Scan image for pixel deletion candidates.		*/
+
+	for (int y = y0 ; y < std::min(y1, ysize-1) ; y++ ) {
+		const bool edge = (y+1 == y1);
+		q = qb(0);
+		p = ((q<<3)&0110) | ((edge ? below[0] : (*this)(0,y+1)) != 0);
+
+		for (int x = 0 ; x < xsize-1 ; x++ ) {
+			q = qb(x);
+			p = ((p<<1)&0666) | ((q<<3)&0110) | ((edge ? below[x+1] : (*this)(x+1,y+1)) != 0);
+			qb(x) = p;
+			if  ( ((p&m) == 0) && xdelete[p] ) {
+				if ((*this)(x,y) < threshold)
+				{
+					count++;
+					(*this)(x,y) = 0;
+				}
+			}
+		}
+
+		/* Process right edge pixel.			*/
+		p = (p<<1)&0666;
+		if	( (p&m) == 0 && xdelete[p] ) {
+			if ((*this)(xsize-1,y) < threshold)
+			{
+				count++;
+				(*this)(xsize-1,y) = 0;
+			}
+		}
+	}
+
+	if (y1 == ysize)
+	{
+		/* Process bottom scan line.				*/
+		for (int x = 0 ; x < xsize ; x++ ) {
+			q = qb(x);
+			p = ((p<<1)&0666) | ((q<<3)&0110);
+			if	( (p&m) == 0 && xdelete[p] ) {
+				if ((*this)(x,ysize-1) < threshold)
+				{
+					count++;
+					(*this)(x,ysize-1) = 0;
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+/*	Neighborhood map of thin_band() of pixel x,y: bits 6-8, 3-5 and	*/
+/*	0-2 are the rows y-1, y and y+1, in each the highest bit is x-1	*/
+/*	and the lowest x+1.  Pixels outside the image are unset.	*/
+
+int thin_map(const int x, const int y) const
+{
+	int p = 0;
+	for (int yn = y-1; yn <= y+1; yn++)
+		for (int xn = x-1; xn <= x+1; xn++)
+		{
+			p <<= 1;
+			if ((xn >= 0) && (yn >= 0) && (xn < width()) && (yn < height()))
+				if ((*this)(xn,yn) != 0) p |= 1;
+		}
+	return p;
+}
+
+/* ---- thin_queue - Thin binary image with a worklist. ---------------- */
+/*									*/
+/*	Same result, return value and progress output as thin() for	*/
+/*	images with the first two columns unset (thin() takes the maps	*/
+/*	of the first column from the second one) but instead of	*/
+/*	scanning the whole image in every sub pass only the		*/
+/*	candidates of a worklist are tested.  The decision for a pixel	*/
+/*	only depends on its neighborhood map so it can only change in	*/
+/*	the four sub passes after a neighbor was deleted.  The worklist	*/
+/*	starts with the pixels below threshold next to an unset pixel	*/
+/*	(others can not be deleted) and the remaining pixels below	*/
+/*	threshold next to deleted ones are added.  The cost follows the	*/
+/*	number of deleted pixels instead of the number of passes times	*/
+/*	the image size.  Unlike thin() this runs on a single thread.	*/
+/*									*/
+/* -------------------------------------------------------------------- */
+
+size_t thin_queue(const T threshold, bool Progress = false)
+{
+	const int xsize = width();
+	const int ysize = height();
+	int pc = 0;           /* Pass count			*/
+	int s = 0;            /* Sub pass count		*/
+	size_t count = 1;     /* Deleted pixel count		*/
+	size_t tcount = 0;
+
+	/* Last sub pass a neighbor of the pixel was deleted in, the	*/
+	/* pixel is in work while this is at least s-4.		*/
+	CImg<int> stamp = CImg<int>(xsize,ysize,1,1,-5);
+
+	std::vector<Point> work;
+	std::vector<Point> del;
+
+	cimg_forXY(*this,x,y)
+	{
+		if (((*this)(x,y) != 0) && ((*this)(x,y) < threshold))
+			if ((thin_map(x,y) & 0252) != 0252)
+			{
+				stamp(x,y) = -1;
+				work.push_back(Point(x,y));
+			}
+	}
+
+	while ( count ) {		/* Passes while deletions	*/
+		pc++;
+		count = 0;
+		for (int i=0; i<4; i++, s++) {
+			const int m = masks[i]; /* Deletion direction mask */
+
+			/* Test with the image state at the start of the sub pass */
+			del.clear();
+			size_t n = 0;
+			for (size_t j = 0; j < work.size(); j++)
+			{
+				const Point c = work[j];
+				if (((*this)(c.x,c.y) == 0) || (stamp(c.x,c.y) < s-4))
+					continue;
+				work[n++] = c;
+				const int p = thin_map(c.x,c.y);
+				if ( ((p&m) == 0) && xdelete[p] )
+					del.push_back(c);
+			}
+			work.resize(n);
+
+			for (size_t j = 0; j < del.size(); j++)
+				(*this)(del[j].x,del[j].y) = 0;
+
+			for (size_t j = 0; j < del.size(); j++)
+				for (int k = 1; k < 9; k++)
+				{
+					const int xn = del[j].x + xo[k];
+					const int yn = del[j].y + yo[k];
+					if ((xn >= 0) && (yn >= 0) && (xn < xsize) && (yn < ysize))
+						if (((*this)(xn,yn) != 0) && ((*this)(xn,yn) < threshold))
+						{
+							if (stamp(xn,yn) < s-4)
+								work.push_back(Point(xn,yn));
+							stamp(xn,yn) = s;
+						}
+				}
+
+			count += del.size();
+		}
+
+		if (Progress)
+			std::fprintf (stderr, "thin(): pass %d, %d pixels deleted.\n", pc, (int)count);
+		tcount += count;
+	}
+	return tcount;
+}
+
 size_t floodfill4(int x, int y, T val, T val_fill)
 {
 	std::stack<Point> Q;
@@ -157,51 +333,149 @@ size_t floodfill4(int x, int y, T val, T val_fill)
 	return cnt;
 }
 
-bool is_end3(int x, int y)
+/* Neighborhood code (see skeleton.h) of pixel x,y.			*/
+
+unsigned char neighbor_code(const int x, const int y) const
 {
-	int ncnt = 0;
-	int xcnt = 0;
-	int prev = (*this)(x+xo[8],y+yo[8]);
+	unsigned char code = 0;
 	for (int i = 1; i < 9; i++)
 	{
-		int xn = x + xo[i];
-		int yn = y + yo[i];
-		if (xn >= 0)
-			if (yn >= 0)
-				if (xn < width())
-					if (yn < height())
-						if ((*this)(xn,yn) != 0)
-						{
-							ncnt++;
-							if (ncnt > 3) return false;
-							prev = 1;
-						}
-						else
-						{
-							if (prev != 0) xcnt ++;
-							if (xcnt > 1) return false;
-							prev = 0;
-						}
+		const int xn = x + xo[i];
+		const int yn = y + yo[i];
+		if ((xn >= 0) && (yn >= 0) && (xn < width()) && (yn < height()))
+			if ((*this)(xn,yn) != 0)
+				code |= 1 << (i-1);
+	}
+	return code;
+}
+
+/* Neighborhood codes of all pixels.  Every row is assembled from the	*/
+/* binarized rows above, below and itself padded by a zero pixel on	*/
+/* both sides, so the inner loop has no bounds checks and vectorizes.	*/
+
+void neighbor_codes(CImg<unsigned char> &codes) const
+{
+	const int xsize = width();
+	const int ysize = height();
+
+	codes.assign(xsize, ysize, 1, 1);
+
+#pragma omp parallel
+	{
+		std::vector<unsigned char> rows(3*(xsize+2), 0);
+		unsigned char *u = &rows[0];
+		unsigned char *c = u + xsize+2;
+		unsigned char *d = c + xsize+2;
+
+#pragma omp for schedule(static)
+		for (int y = 0; y < ysize; y++)
+		{
+			for (int x = 0; x < xsize; x++)
+			{
+				u[x+1] = (y > 0) ? ((*this)(x,y-1) != 0) : 0;
+				c[x+1] = ((*this)(x,y) != 0);
+				d[x+1] = (y < ysize-1) ? ((*this)(x,y+1) != 0) : 0;
+			}
 
+			unsigned char *r = codes.data() + (size_t)y*xsize;
+			for (int x = 0; x < xsize; x++)
+				r[x] = u[x] | (u[x+1] << 1) | (u[x+2] << 2) | (c[x+2] << 3) |
+				       (d[x+2] << 4) | (d[x+1] << 5) | (d[x] << 6) | (c[x] << 7);
+		}
 	}
-	return true;
 }
 
-int n_adj(int x, int y)
+/* End point test, see code_end3 in skeleton.h.				*/
+
+bool is_end3(int x, int y) const
 {
-	int ncnt = 0;
-	for (int i = 1; i < 9; i++)
+	return code_end3[neighbor_code(x, y)] != 0;
+}
+
+/* Number of non-zero neighbors.					*/
+
+int n_adj(int x, int y) const
+{
+	return code_adj[neighbor_code(x, y)];
+}
+
+/* Depth of iterated end point removal: repeatedly deleting all pixels  */
+/* is_end3() reports as end points (evaluated on the state before the   */
+/* iteration) is done once, recording for every pixel the number of     */
+/* iterations it survives.  Result is 0 for unset pixels, j+1 for       */
+/* pixels deleted in iteration j and maxdepth+1 for pixels surviving    */
+/* maxdepth iterations, so the skeleton shortened by k <= maxdepth      */
+/* iterations consists of the pixels with a depth > k.  Only pixels at  */
+/* least margin pixels away from the image border are deleted.  After   */
+/* the first iteration only neighbors of deleted pixels are tested again */
+/* so the cost depends on the number of deleted pixels, not on the     */
+/* image size times the number of iterations.  The end point test reads */
+/* codes, the neighborhood codes of this image from neighbor_codes(),   */
+/* which are updated on deletion.  Pixels not deleted yet have a depth  */
+/* of maxdepth+1.                                                        */
+
+CImg<unsigned short> get_prune_depth(const int maxdepth, CImg<unsigned char> &codes, const int margin = 3) const
+{
+	const int xsize = width();
+	const int ysize = height();
+
+	const int mg = std::max(margin, 1);
+
+	CImg<unsigned short> depth = CImg<unsigned short>(xsize,ysize,1,1,0);
+	CImg<int> stamp = CImg<int>(xsize,ysize,1,1,-1);
+
+	std::vector<Point> cand;
+	std::vector<Point> del;
+
+	cimg_forXY(*this,x,y)
 	{
-		int xn = x + xo[i];
-		int yn = y + yo[i];
-		if (xn >= 0)
-			if (yn >= 0)
-				if (xn < width())
-					if (yn < height())
-						if ((*this)(xn,yn) != 0)
+		if ((*this)(x,y) != 0)
+		{
+			depth(x,y) = maxdepth+1;
+			if ((x >= mg) && (y >= mg) && (x < xsize-mg) && (y < ysize-mg))
+				cand.push_back(Point(x,y));
+		}
+	}
+
+	for (int j = 0; (j < maxdepth) && !cand.empty(); j++)
+	{
+		del.clear();
+		for (size_t i = 0; i < cand.size(); i++)
+			if (depth(cand[i].x,cand[i].y) > maxdepth)
+				if (code_end3[codes(cand[i].x,cand[i].y)])
+					del.push_back(cand[i]);
+
+		/* neighbor k of a pixel has the pixel as neighbor (k+3)%8+1 */
+		for (size_t i = 0; i < del.size(); i++)
+		{
+			depth(del[i].x,del[i].y) = j+1;
+			for (int k = 1; k < 9; k++)
+				codes(del[i].x+xo[k],del[i].y+yo[k]) &= ~(1 << ((k+3)%8));
+		}
+
+		/* Only pixels next to deleted ones can become end points. */
+		cand.clear();
+		for (size_t i = 0; i < del.size(); i++)
+			for (int k = 1; k < 9; k++)
+			{
+				const int xn = del[i].x + xo[k];
+				const int yn = del[i].y + yo[k];
+				if ((xn >= mg) && (yn >= mg) && (xn < xsize-mg) && (yn < ysize-mg))
+					if (depth(xn,yn) > maxdepth)
+						if (stamp(xn,yn) != j)
 						{
-							ncnt++;
+							stamp(xn,yn) = j;
+							cand.push_back(Point(xn,yn));
 						}
+			}
 	}
-	return ncnt;
+
+	return depth;
+}
+
+CImg<unsigned short> get_prune_depth(const int maxdepth, const int margin = 3) const
+{
+	CImg<unsigned char> codes;
+	neighbor_codes(codes);
+	return get_prune_depth(maxdepth, codes, margin);
 }
@@ -0,0 +1,441 @@
+/* ========================================================================
+    File: @(#)bench.cpp
+   ------------------------------------------------------------------------
+    coastline_bench kernel and pipeline benchmarks for coastline_gen
+    Copyright (C) 2013 Christoph Hormann <chris_hormann@gmx.de>
+   ------------------------------------------------------------------------
+
+    This file is part of coastline_gen
+
+    coastline_gen is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    coastline_gen is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with coastline_gen.  If not, see <http://www.gnu.org/licenses/>.
+
+   ========================================================================
+ */
+
+/*
+ * Benchmarks on synthetic land water masks generated from fractal noise,
+ * no input data needed.  Every kernel is run repeatedly on every shape and
+ * size until the minimum time is reached, the preparation of the input
+ * (like copying an image the kernel modifies) is not counted.  Throughput
+ * is given in megapixels of the image per second.
+ */
+
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "coastline.h"
+#include "bitmask.h"
+#include "blur.h"
+#include "coastline_cimg.h"
+
+const char BENCH_TITLE[] = "coastline_bench";
+
+// --- synthetic coastlines ---
+
+// hash of a lattice point to [0,1)
+static float lattice(const int x, const int y, const unsigned int seed)
+{
+	unsigned int h = seed;
+	h ^= (unsigned int)x * 0x8da6b343u;
+	h ^= (unsigned int)y * 0xd8163841u;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	h *= 0x297a2d39u;
+	h ^= h >> 15;
+	return (h & 0xffffff) / 16777216.0f;
+}
+
+// smoothly interpolated value noise
+static float value_noise(const float x, const float y, const unsigned int seed)
+{
+	const int ix = (int)std::floor(x);
+	const int iy = (int)std::floor(y);
+	float fx = x - ix;
+	float fy = y - iy;
+	fx = fx*fx*(3.0f - 2.0f*fx);
+	fy = fy*fy*(3.0f - 2.0f*fy);
+	const float v00 = lattice(ix, iy, seed);
+	const float v10 = lattice(ix+1, iy, seed);
+	const float v01 = lattice(ix, iy+1, seed);
+	const float v11 = lattice(ix+1, iy+1, seed);
+	return (v00*(1.0f-fx) + v10*fx)*(1.0f-fy) + (v01*(1.0f-fx) + v11*fx)*fy;
+}
+
+// fractal noise in [0,1), period is the wavelength of the first octave
+static float fbm(const float x, const float y, const float period, const unsigned int seed)
+{
+	float v = 0.0f;
+	float a = 0.5f;
+	float f = 1.0f/period;
+	float norm = 0.0f;
+	for (int o = 0; o < 8; o++)
+	{
+		v += a*value_noise(x*f, y*f, seed + o*1013);
+		norm += a;
+		a *= 0.5f;
+		f *= 2.0f;
+	}
+	return v/norm;
+}
+
+enum Shape { SHAPE_SHORE, SHAPE_ARCHIPELAGO, SHAPE_FJORDS, SHAPES };
+
+static const char *shape_name[SHAPES] = { "shore", "archipelago", "fjords" };
+
+// land water mask with land 255, the features scale with the image size
+static CImg<unsigned char> synthetic_coastline(const Shape shape, const int size)
+{
+	CImg<unsigned char> img(size, size, 1, 1, 0);
+	const float s = size;
+
+#pragma omp parallel for
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++)
+		{
+			bool land = false;
+			if (shape == SHAPE_SHORE)
+			{
+				// one main land area with a rough coast
+				land = (x/s - 0.5f) + 0.6f*(fbm(x, y, s/4, 1) - 0.5f) < 0.0f;
+			}
+			else if (shape == SHAPE_ARCHIPELAGO)
+			{
+				// many islands of all sizes
+				land = fbm(x, y, s/16, 2) > 0.6f;
+			}
+			else
+			{
+				// main land cut by long narrow inlets
+				const float n = fbm(x, y, s/6, 3);
+				land = (x/s - 0.7f) + 0.3f*(n - 0.5f) < 0.0f;
+				if (land && (x > s*0.15f))
+				{
+					const float w = std::sin(y*64.0f/s + 12.0f*n);
+					if (std::fabs(w) < 0.12f + 0.1f*(x/s)) land = false;
+				}
+			}
+			img(x,y) = land ? 255 : 0;
+		}
+
+	return img;
+}
+
+// --- kernels ---
+
+/*
+ * A kernel gets the synthetic mask in setup(), prepare() is called before
+ * every timed run().  run() returns a count of its results which is
+ * printed to detect kernels that do nothing.
+ */
+
+struct Kernel
+{
+	virtual ~Kernel() {}
+	virtual const char *name() const = 0;
+	virtual void setup(const CImg<unsigned char> &mask) { src = mask; }
+	virtual void prepare() {}
+	virtual size_t run() = 0;
+
+	CImg<unsigned char> src;
+};
+
+// input of thin() with threshold 200 similar to generalize(): land further
+// than 8 pixels from the coast is fixed (255), the coastal band variable
+// (128) and the pixels at the image border are cleared
+static CImg<unsigned char> thin_input(const CImg<unsigned char> &mask)
+{
+	const CImg<unsigned char> core = mask.get_erode_disk(8.0f);
+	CImg<unsigned char> img(mask.width(), mask.height(), 1, 1, 0);
+	for (int y = 2; y < mask.height()-2; y++)
+		for (int x = 2; x < mask.width()-2; x++)
+			if (mask(x,y) != 0) img(x,y) = (core(x,y) != 0) ? 255 : 128;
+	return img;
+}
+
+// skeleton of the land as input of the neighborhood tests
+static CImg<unsigned char> skeleton_of(const CImg<unsigned char> &mask)
+{
+	CImg<unsigned char> img = thin_input(mask);
+	img.thin_queue(200);
+	return img;
+}
+
+struct ThinKernel: Kernel
+{
+	const char *name() const { return "thin"; }
+	void setup(const CImg<unsigned char> &mask) { src = thin_input(mask); }
+	void prepare() { img = src; }
+	size_t run() { return img.thin(200); }
+	CImg<unsigned char> img;
+};
+
+struct ThinQueueKernel: Kernel
+{
+	const char *name() const { return "thin_queue"; }
+	void setup(const CImg<unsigned char> &mask) { src = thin_input(mask); }
+	void prepare() { img = src; }
+	size_t run() { return img.thin_queue(200); }
+	CImg<unsigned char> img;
+};
+
+struct FloodfillKernel: Kernel
+{
+	const char *name() const { return "floodfill4"; }
+	void prepare() { img = src; }
+	size_t run()
+	{
+		size_t n = 0;
+		cimg_forXY(img,x,y)
+			if (img(x,y) == 255)
+			{
+				img.floodfill4(x, y, 255, 128);
+				n++;
+			}
+		return n;
+	}
+	CImg<unsigned char> img;
+};
+
+struct EndKernel: Kernel
+{
+	const char *name() const { return "is_end3"; }
+	void setup(const CImg<unsigned char> &mask) { src = skeleton_of(mask); }
+	size_t run()
+	{
+		src.neighbor_codes(codes);
+		size_t n = 0;
+		for (int y = 1; y < src.height()-1; y++)
+			for (int x = 1; x < src.width()-1; x++)
+				if (src(x,y) != 0)
+					if (code_end3[codes(x,y)]) n++;
+		return n;
+	}
+	CImg<unsigned char> codes;
+};
+
+struct AdjKernel: Kernel
+{
+	const char *name() const { return "n_adj"; }
+	void setup(const CImg<unsigned char> &mask) { src = skeleton_of(mask); }
+	size_t run()
+	{
+		src.neighbor_codes(codes);
+		size_t n = 0;
+		cimg_forXY(src,x,y)
+			if (src(x,y) != 0)
+				n += code_adj[codes(x,y)];
+		return n;
+	}
+	CImg<unsigned char> codes;
+};
+
+struct ErodeDiskKernel: Kernel
+{
+	const char *name() const { return "erode_disk"; }
+	size_t run() { return src.get_erode_disk(4.0f).size(); }
+};
+
+struct DilateDiskKernel: Kernel
+{
+	const char *name() const { return "dilate_disk"; }
+	size_t run() { return src.get_dilate_disk(4.0f).size(); }
+};
+
+struct ErodeSquareKernel: Kernel
+{
+	const char *name() const { return "erode_square"; }
+	size_t run() { return src.get_erode_square(5).size(); }
+};
+
+struct BitMaskKernel: Kernel
+{
+	const char *name() const { return "bitmask_morph"; }
+	void prepare() { m.assign_nonzero(src.data(), src.width(), src.height()); }
+	size_t run()
+	{
+		m.erode(5);
+		m.dilate(5);
+		return m.width();
+	}
+	BitMask m;
+};
+
+struct BlurKernel: Kernel
+{
+	const char *name() const { return "blur_mask"; }
+	void prepare() { img = src; }
+	size_t run()
+	{
+		blur_mask(img.data(), img.width(), img.height(), 4.0f);
+		return img.size();
+	}
+	CImg<unsigned char> img;
+};
+
+struct DistanceKernel: Kernel
+{
+	const char *name() const { return "distance2"; }
+	size_t run()
+	{
+		src.distance2(0, dist2, ft);
+		return dist2.size();
+	}
+	CImg<unsigned int> dist2;
+	CImg<int> ft;
+};
+
+struct LabelKernel: Kernel
+{
+	const char *name() const { return "label4"; }
+	size_t run() { return src.label4(255, labels, stats); }
+	CImg<unsigned int> labels;
+	std::vector<ComponentStats> stats;
+};
+
+struct PipelineKernel: Kernel
+{
+	const char *name() const { return "pipeline"; }
+	void prepare() { img = src; }
+	size_t run()
+	{
+		G.run(img.data(), img.width(), img.height(), NULL, NULL, P);
+		return img.size();
+	}
+	Parameters P;
+	Generalizer G;
+	CImg<unsigned char> img;
+};
+
+// --- benchmark driver ---
+
+int main(int argc,char **argv)
+{
+	std::fprintf(stderr,"%s\n", BENCH_TITLE);
+
+	cimg_usage("Usage: coastline_bench [options]");
+
+	const char *size_string = cimg_option("-s","512:1024:2048","image sizes (colon separated)");
+	const char *filter = cimg_option("-k",(char*)NULL,"only run kernels containing this string");
+	const float MinTime = cimg_option("-mt",0.5,"minimum time per kernel and image in seconds");
+	const bool Save = cimg_option("-save",false,"write the synthetic masks as bench-<shape>-<size>.pgm");
+	const bool Verbose = cimg_option("-v",false,"show the stage output of the pipeline");
+
+	const bool helpflag = cimg_option("-h",false,"Display this help");
+	if (helpflag) std::exit(0);
+
+	std::vector<int> sizes;
+	{
+		std::string s(size_string);
+		size_t pos = 0;
+		while (pos < s.size())
+		{
+			const int v = std::atoi(s.c_str() + pos);
+			if (v > 0) sizes.push_back(v);
+			pos = s.find(':', pos);
+			if (pos == std::string::npos) break;
+			pos++;
+		}
+	}
+
+	PipelineKernel *pipeline = new PipelineKernel();
+
+	std::vector<Kernel *> kernels;
+	kernels.push_back(new ThinKernel());
+	kernels.push_back(new ThinQueueKernel());
+	kernels.push_back(new FloodfillKernel());
+	kernels.push_back(new EndKernel());
+	kernels.push_back(new AdjKernel());
+	kernels.push_back(new ErodeDiskKernel());
+	kernels.push_back(new DilateDiskKernel());
+	kernels.push_back(new ErodeSquareKernel());
+	kernels.push_back(new BitMaskKernel());
+	kernels.push_back(new BlurKernel());
+	kernels.push_back(new DistanceKernel());
+	kernels.push_back(new LabelKernel());
+	kernels.push_back(pipeline);
+
+	int threads = 1;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	std::printf("# %s, %d threads, minimum time %.2f s\n", BENCH_TITLE, threads, MinTime);
+	std::printf("# %-14s %-12s %6s %8s %10s %10s %10s\n", "kernel", "shape", "size", "runs", "ms/run", "MP/s", "result");
+
+	for (size_t si = 0; si < sizes.size(); si++)
+		for (int sh = 0; sh < SHAPES; sh++)
+		{
+			const int size = sizes[si];
+			const CImg<unsigned char> mask = synthetic_coastline((Shape)sh, size);
+			if (Save)
+			{
+				char filename[256];
+				std::snprintf(filename, sizeof(filename), "bench-%s-%d.pgm", shape_name[sh], size);
+				mask.save(filename);
+			}
+
+			for (size_t k = 0; k < kernels.size(); k++)
+			{
+				Kernel &K = *kernels[k];
+				if ((filter != NULL) && (std::strstr(K.name(), filter) == NULL)) continue;
+
+				// the pipeline prints its stages to stderr
+				int err = -1;
+				if (!Verbose && (&K == pipeline))
+				{
+					const int null = open("/dev/null", O_WRONLY);
+					if (null >= 0)
+					{
+						std::fflush(stderr);
+						err = dup(2);
+						dup2(null, 2);
+						close(null);
+					}
+				}
+
+				K.setup(mask);
+				int runs = 0;
+				double t = 0.0;
+				size_t result = 0;
+				while ((t < MinTime) || (runs == 0))
+				{
+					K.prepare();
+					const double t0 = wall_seconds();
+					result = K.run();
+					t += wall_seconds() - t0;
+					runs++;
+				}
+				K.src.assign();
+
+				if (err >= 0)
+				{
+					std::fflush(stderr);
+					dup2(err, 2);
+					close(err);
+				}
+
+				const double mp = (double)size*size*1e-6;
+				std::printf("  %-14s %-12s %6d %8d %10.3f %10.2f %10lu\n",
+				            K.name(), shape_name[sh], size, runs, 1000.0*t/runs, mp*runs/t, (unsigned long)result);
+				std::fflush(stdout);
+			}
+		}
+
+	for (size_t k = 0; k < kernels.size(); k++)
+		delete kernels[k];
+
+	return 0;
+}
@@ -0,0 +1,290 @@
+// packed binary mask with word parallel morphology
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+/*
+ * One bit per pixel, every row starts at a 64 bit word.  Bits beyond the
+ * width in the last word of a row are always 0.  All operations work on
+ * whole words, the plain loops over rows vectorize with -O3.
+ *
+ * erode() and dilate() use the same window placement as CImg erode(s) and
+ * dilate(s) and ignore pixels outside the image.
+ */
+
+class BitMask
+{
+public:
+	BitMask(): w(0), h(0), nw(0) {}
+
+	BitMask(const int xsize, const int ysize, const bool value = false)
+	{
+		assign(xsize, ysize, value);
+	}
+
+	void assign(const int xsize, const int ysize, const bool value = false)
+	{
+		w = xsize;
+		h = ysize;
+		nw = (w+63)/64;
+		bits.assign((size_t)nw*h, value ? ~(uint64_t)0 : 0);
+		if (value) clear_tail();
+	}
+
+	// set pixels with lo <= data <= hi of a byte image
+	void assign_range(const unsigned char *data, const int xsize, const int ysize,
+	                  const unsigned char lo, const unsigned char hi)
+	{
+		assign(xsize, ysize);
+		for (int y = 0; y < h; y++)
+		{
+			const unsigned char *src = data + (size_t)y*w;
+			uint64_t *r = row(y);
+			for (int x = 0; x < w; x++)
+				if ((src[x] >= lo) && (src[x] <= hi))
+					r[x >> 6] |= (uint64_t)1 << (x & 63);
+		}
+	}
+
+	void assign_nonzero(const unsigned char *data, const int xsize, const int ysize)
+	{
+		assign_range(data, xsize, ysize, 1, 255);
+	}
+
+	// write set pixels as on and the others as off
+	void to_bytes(unsigned char *data, const unsigned char on, const unsigned char off = 0) const
+	{
+		for (int y = 0; y < h; y++)
+		{
+			unsigned char *dst = data + (size_t)y*w;
+			const uint64_t *r = row(y);
+			for (int x = 0; x < w; x++)
+				dst[x] = ((r[x >> 6] >> (x & 63)) & 1) ? on : off;
+		}
+	}
+
+	int width() const { return w; }
+	int height() const { return h; }
+	bool is_empty() const { return bits.empty(); }
+
+	bool get(const int x, const int y) const
+	{
+		return (bits[(size_t)y*nw + (x >> 6)] >> (x & 63)) & 1;
+	}
+
+	void set(const int x, const int y, const bool value = true)
+	{
+		const uint64_t b = (uint64_t)1 << (x & 63);
+		if (value)
+			bits[(size_t)y*nw + (x >> 6)] |= b;
+		else
+			bits[(size_t)y*nw + (x >> 6)] &= ~b;
+	}
+
+	uint64_t *row(const int y) { return &bits[(size_t)y*nw]; }
+	const uint64_t *row(const int y) const { return &bits[(size_t)y*nw]; }
+
+	bool operator==(const BitMask &m) const
+	{
+		return (w == m.w) && (h == m.h) && (bits == m.bits);
+	}
+
+	BitMask &operator&=(const BitMask &m)
+	{
+		for (size_t i = 0; i < bits.size(); i++) bits[i] &= m.bits[i];
+		return *this;
+	}
+
+	BitMask &operator|=(const BitMask &m)
+	{
+		for (size_t i = 0; i < bits.size(); i++) bits[i] |= m.bits[i];
+		return *this;
+	}
+
+	// this = this & ~m
+	BitMask &and_not(const BitMask &m)
+	{
+		for (size_t i = 0; i < bits.size(); i++) bits[i] &= ~m.bits[i];
+		return *this;
+	}
+
+	BitMask &invert()
+	{
+		for (size_t i = 0; i < bits.size(); i++) bits[i] = ~bits[i];
+		clear_tail();
+		return *this;
+	}
+
+	BitMask &erode(const unsigned int s)
+	{
+		if (s > 1) erode_window(s - s/2 - 1, s/2);
+		return *this;
+	}
+
+	BitMask &dilate(const unsigned int s)
+	{
+		if (s > 1)
+		{
+			// out of image pixels are ignored, which is 0 for dilation and 1
+			// for erosion of the complement
+			invert();
+			erode_window(s/2, s - s/2 - 1);
+			invert();
+		}
+		return *this;
+	}
+
+	// pixels with at least k of their 8 neighbors set
+	BitMask get_neighbors(const int k) const
+	{
+		BitMask res(w, h);
+		const std::vector<uint64_t> zero(nw, 0);
+
+		for (int y = 0; y < h; y++)
+		{
+			const uint64_t *rows[3];
+			rows[0] = (y > 0) ? row(y-1) : &zero[0];
+			rows[1] = row(y);
+			rows[2] = (y < h-1) ? row(y+1) : &zero[0];
+			uint64_t *r = res.row(y);
+
+			for (int i = 0; i < nw; i++)
+			{
+				// bit sliced 4 bit counters
+				uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+				for (int j = 0; j < 3; j++)
+				{
+					const uint64_t *q = rows[j];
+					const uint64_t left = (q[i] << 1) | ((i > 0) ? (q[i-1] >> 63) : 0);
+					const uint64_t right = (q[i] >> 1) | ((i < nw-1) ? (q[i+1] << 63) : 0);
+					const uint64_t v[3] = { left, q[i], right };
+					for (int l = 0; l < 3; l++)
+					{
+						if ((j == 1) && (l == 1)) continue;
+						uint64_t c = c0 & v[l];
+						c0 ^= v[l];
+						const uint64_t c_ = c1 & c;
+						c1 ^= c;
+						c = c2 & c_;
+						c2 ^= c_;
+						c3 |= c;
+					}
+				}
+
+				// count >= k
+				const uint64_t cnt[4] = { c0, c1, c2, c3 };
+				uint64_t ge = 0;
+				uint64_t eq = ~(uint64_t)0;
+				for (int j = 3; j >= 0; j--)
+				{
+					const uint64_t kb = ((k >> j) & 1) ? ~(uint64_t)0 : 0;
+					ge |= eq & cnt[j] & ~kb;
+					eq &= ~(cnt[j] ^ kb);
+				}
+				r[i] = ge | eq;
+			}
+		}
+
+		res.clear_tail();
+		return res;
+	}
+
+private:
+	int w, h, nw;
+	std::vector<uint64_t> bits;
+
+	void clear_tail()
+	{
+		if ((w & 63) == 0) return;
+		const uint64_t m = ((uint64_t)1 << (w & 63)) - 1;
+		for (int y = 0; y < h; y++)
+			row(y)[nw-1] &= m;
+	}
+
+	// 64 bits of a padded row starting at bit pos, 1 beyond the row end
+	static uint64_t fetch(const std::vector<uint64_t> &p, const size_t pos)
+	{
+		const size_t q = pos >> 6;
+		const int r = pos & 63;
+		const uint64_t lo = (q < p.size()) ? p[q] : ~(uint64_t)0;
+		if (r == 0) return lo;
+		const uint64_t hi = (q+1 < p.size()) ? p[q+1] : ~(uint64_t)0;
+		return (lo >> r) | (hi << (64-r));
+	}
+
+	// AND over the window [x-lo, x+hi], pixels outside the image ignored
+	void erode_window(const int lo, const int hi)
+	{
+		const int s = lo + hi + 1;
+
+		// rows: the padded row p(i) = row(i-lo) is 1 outside the image, the
+		// window of x is p(x..x+s-1), composed from power of two runs
+		const int n = w + s - 1;
+		const int pw = (n+63)/64;
+		std::vector<uint64_t> p(pw), run(pw), acc(pw), tmp(pw);
+		for (int y = 0; y < h; y++)
+		{
+			uint64_t *r = row(y);
+			std::fill(p.begin(), p.end(), ~(uint64_t)0);
+			for (int x = 0; x < w; x++)
+				if (!((r[x >> 6] >> (x & 63)) & 1))
+					p[(x+lo) >> 6] &= ~((uint64_t)1 << ((x+lo) & 63));
+
+			run = p;
+			std::fill(acc.begin(), acc.end(), ~(uint64_t)0);
+			int off = 0;
+			for (int len = 1; len <= s; len <<= 1)
+			{
+				if (s & len)
+				{
+					for (int i = 0; i < pw; i++)
+						acc[i] &= fetch(run, (size_t)i*64 + off);
+					off += len;
+				}
+				if (2*len <= s)
+				{
+					for (int i = 0; i < pw; i++)
+						tmp[i] = run[i] & fetch(run, (size_t)i*64 + len);
+					run.swap(tmp);
+				}
+			}
+			for (int i = 0; i < nw; i++)
+				r[i] = acc[i];
+		}
+		clear_tail();
+
+		// columns: van Herk/Gil-Werman on whole words over padded rows
+		const int m = h + s - 1;
+		std::vector<uint64_t> g((size_t)m*nw), hh((size_t)m*nw);
+		for (int j = 0; j < m; j++)
+		{
+			const int y = j - lo;
+			for (int i = 0; i < nw; i++)
+			{
+				const uint64_t v = ((y >= 0) && (y < h)) ? row(y)[i] : ~(uint64_t)0;
+				g[(size_t)j*nw + i] = ((j % s) == 0) ? v : (g[(size_t)(j-1)*nw + i] & v);
+			}
+		}
+		for (int j = m-1; j >= 0; j--)
+		{
+			const int y = j - lo;
+			for (int i = 0; i < nw; i++)
+			{
+				const uint64_t v = ((y >= 0) && (y < h)) ? row(y)[i] : ~(uint64_t)0;
+				hh[(size_t)j*nw + i] = ((((j+1) % s) == 0) || (j == m-1)) ? v : (hh[(size_t)(j+1)*nw + i] & v);
+			}
+		}
+		for (int y = 0; y < h; y++)
+			for (int i = 0; i < nw; i++)
+				row(y)[i] = hh[(size_t)y*nw + i] & g[(size_t)(y+s-1)*nw + i];
+		clear_tail();
+	}
+};
+
+#endif
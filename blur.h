@@ -0,0 +1,488 @@
+// fused recursive smoothing of several byte layers
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef BLUR_H
+#define BLUR_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+/*
+ * Deriche recursive filter of order 0 with Neumann boundaries, using the
+ * same recurrence and rounding as CImg blur() on unsigned char images:
+ * every axis pass runs the causal and anticausal recursion in double and
+ * stores the truncated sum back as byte, sigma < 0.1 leaves the data
+ * unchanged.
+ *
+ * Up to BLUR_LAYERS layers of the same size are smoothed together.  The
+ * horizontal pass runs the recursions of all layers of a row in lockstep
+ * on interleaved lanes, the vertical pass sweeps the rows of strips of
+ * BLUR_STRIP columns instead of walking single columns with image width
+ * stride.  The inner loops run over lanes and columns and vectorize.  A
+ * per pixel rule is applied to the values of all layers in the last sweep,
+ * so no separate pass over the layers is needed afterwards.
+ */
+
+const static int BLUR_LAYERS = 8;
+const static int BLUR_STRIP = 8;
+
+struct DericheCoefs
+{
+	double a0, a1, a2, a3, b1, b2, coefp, coefn;
+
+	DericheCoefs(const float sigma)
+	{
+		const double nsigma = (sigma < 0.1f) ? 0.1f : sigma;
+		const double alpha = 1.695f/nsigma;
+		const double ema = std::exp(-alpha);
+		const double ema2 = std::exp(-2*alpha);
+		b1 = -2*ema;
+		b2 = ema2;
+		const double k = (1-ema)*(1-ema)/(1 + 2*alpha*ema - ema2);
+		a0 = k;
+		a1 = k*(alpha-1)*ema;
+		a2 = k*(alpha+1)*ema;
+		a3 = -k*ema2;
+		coefp = (a0+a1)/(1+b1+b2);
+		coefn = (a2+a3)/(1+b1+b2);
+	}
+};
+
+static inline unsigned char blur_store(const double v)
+{
+	return (v < 0) ? 0 : ((v >= 255) ? 255 : (unsigned char)v);
+}
+
+/* Causal and anticausal recursion over n steps on m independent lanes.	*/
+/* load(i, x) provides the m inputs of step i, store(i, r) receives the	*/
+/* m results of step i, in decreasing order of i after all loads of the	*/
+/* causal part.  Y is scratch space for n*m values.			*/
+
+template<class Load, class Store>
+static void deriche_lanes(const DericheCoefs &c, const int n, const int m, double *Y, Load &load, Store &store)
+{
+	std::vector<double> xc(m), xp(m), yp(m), yb(m), xa(m);
+
+	load(0, &xp[0]);
+	for (int l = 0; l < m; l++)
+		yb[l] = yp[l] = c.coefp*xp[l];
+
+	for (int i = 0; i < n; i++)
+	{
+		double *yc = Y + (size_t)i*m;
+		load(i, &xc[0]);
+		for (int l = 0; l < m; l++)
+		{
+			yc[l] = c.a0*xc[l] + c.a1*xp[l] - c.b1*yp[l] - c.b2*yb[l];
+			xp[l] = xc[l];
+			yb[l] = yp[l];
+			yp[l] = yc[l];
+		}
+	}
+
+	// xp/yp/yb are xn/yn/ya from here
+	load(n-1, &xa[0]);
+	for (int l = 0; l < m; l++)
+	{
+		xp[l] = xa[l];
+		yb[l] = yp[l] = c.coefn*xa[l];
+	}
+
+	for (int i = n-1; i >= 0; i--)
+	{
+		double *yc = Y + (size_t)i*m;
+		load(i, &xc[0]);
+		for (int l = 0; l < m; l++)
+		{
+			const double v = c.a2*xp[l] + c.a3*xa[l] - c.b1*yp[l] - c.b2*yb[l];
+			xa[l] = xp[l];
+			xp[l] = xc[l];
+			yb[l] = yp[l];
+			yp[l] = v;
+			yc[l] += v;
+		}
+		store(i, yc);
+	}
+}
+
+// inputs and results of a row of the active layers, lanes interleaved
+struct BlurRow
+{
+	unsigned char *const *layers;
+	const int *act;
+	int na;
+	size_t offset;
+
+	void operator()(const int i, double *x) const
+	{
+		for (int l = 0; l < na; l++)
+			x[l] = layers[act[l]][offset + i];
+	}
+};
+
+struct BlurRowStore
+{
+	unsigned char *const *layers;
+	const int *act;
+	int na;
+	size_t offset;
+
+	void operator()(const int i, const double *r) const
+	{
+		for (int l = 0; l < na; l++)
+			layers[act[l]][offset + i] = blur_store(r[l]);
+	}
+};
+
+// inputs of rows of a strip of columns, lanes interleaved
+struct BlurStrip
+{
+	unsigned char *const *layers;
+	const int *act;
+	int na;
+	int xsize;
+	int x0;
+	int w;
+
+	void operator()(const int y, double *x) const
+	{
+		for (int i = 0; i < w; i++)
+			for (int l = 0; l < na; l++)
+				x[i*na + l] = layers[act[l]][(size_t)y*xsize + x0 + i];
+	}
+};
+
+// results of rows of a strip of columns, the rule is applied to every pixel
+template<class Rule>
+struct BlurStripStore
+{
+	unsigned char *const *layers;
+	const int *act;
+	int n;
+	int na;
+	int xsize;
+	int x0;
+	int w;
+	Rule *rule;
+
+	void operator()(const int y, const double *r) const
+	{
+		unsigned char v[BLUR_LAYERS];
+		for (int i = 0; i < w; i++)
+		{
+			const size_t p = (size_t)y*xsize + x0 + i;
+			for (int l = 0; l < n; l++)
+				v[l] = layers[l][p];
+			for (int l = 0; l < na; l++)
+				v[act[l]] = blur_store(r[i*na + l]);
+			(*rule)(v);
+			for (int l = 0; l < n; l++)
+				layers[l][p] = v[l];
+		}
+	}
+};
+
+/* Smooths the active layers of layers[0..n-1] (xsize*ysize bytes each)	*/
+/* with sigma and then calls rule(v) for every pixel with the n layer	*/
+/* values in v, which the rule may change.  The rule must not depend on	*/
+/* other pixels.							*/
+
+template<class Rule>
+void blur_layers(unsigned char *const *layers, const bool *active, const int n,
+                 const int xsize, const int ysize, const float sigma, Rule &rule)
+{
+	const DericheCoefs c(sigma);
+
+	int na = 0;
+	int act[BLUR_LAYERS];
+	if (sigma >= 0.1f)
+		for (int l = 0; l < n; l++)
+			if (active[l])
+				act[na++] = l;
+
+	// horizontal
+	if ((na > 0) && (xsize > 1))
+	{
+#pragma omp parallel
+		{
+			std::vector<double> Y((size_t)xsize*na);
+
+#pragma omp for schedule(static)
+			for (int y = 0; y < ysize; y++)
+			{
+				BlurRow load = { layers, act, na, (size_t)y*xsize };
+				BlurRowStore store = { layers, act, na, (size_t)y*xsize };
+				deriche_lanes(c, xsize, na, &Y[0], load, store);
+			}
+		}
+	}
+
+	// vertical with the rule applied to the results
+	if ((na > 0) && (ysize > 1))
+	{
+		const int nstrips = (xsize + BLUR_STRIP-1)/BLUR_STRIP;
+
+#pragma omp parallel
+		{
+			std::vector<double> Y((size_t)ysize*BLUR_STRIP*na);
+
+#pragma omp for schedule(dynamic)
+			for (int s = 0; s < nstrips; s++)
+			{
+				const int x0 = s*BLUR_STRIP;
+				const int w = std::min(BLUR_STRIP, xsize - x0);
+				BlurStrip load = { layers, act, na, xsize, x0, w };
+				BlurStripStore<Rule> store = { layers, act, n, na, xsize, x0, w, &rule };
+				deriche_lanes(c, ysize, w*na, &Y[0], load, store);
+			}
+		}
+	}
+	else
+	{
+		unsigned char v[BLUR_LAYERS];
+		for (size_t p = 0; p < (size_t)xsize*ysize; p++)
+		{
+			for (int l = 0; l < n; l++)
+				v[l] = layers[l][p];
+			rule(v);
+			for (int l = 0; l < n; l++)
+				layers[l][p] = v[l];
+		}
+	}
+}
+
+/*
+ * Fixed point variant of the same filter for 8 bit masks that are only
+ * thresholded afterwards.  Coefficients have 14 fractional bits, the filter
+ * state 6 bits.  The coefficients are rounded so the DC gain stays exactly
+ * 1, flat areas keep their value.  Every pass truncates like the double
+ * version, rounding in the recursion can shift a result by one level, so
+ * the result differs by at most 2 levels from CImg blur() (tested for
+ * sigma up to 16; larger sigma use the double version).
+ *
+ * Lanes are independent lines: groups of rows in the horizontal pass,
+ * strips of adjacent columns in the vertical pass, so each step of the
+ * recursion is one vector operation over the lanes.  The lane kernels are
+ * compiled for AVX2, SSE4.1 and the baseline and selected at run time.
+ */
+
+const static int BLUR_FIXED_Q = 14;
+const static int BLUR_FIXED_S = 6;
+const static float BLUR_FIXED_MAX_SIGMA = 16.0f;
+
+#ifdef __GNUC__
+#define BLUR_INLINE inline __attribute__((always_inline))
+#else
+#define BLUR_INLINE inline
+#endif
+
+struct DericheFixed
+{
+	int a0, a1, a2, a3, b1, b2;
+	// DC gains of the causal and anticausal part: state = x*gp/d
+	long long gp, gn, d;
+
+	DericheFixed(const float sigma)
+	{
+		const DericheCoefs c(sigma);
+		const double q = 1 << BLUR_FIXED_Q;
+		b1 = (int)std::floor(c.b1*q + 0.5);
+		b2 = (int)std::floor(c.b2*q + 0.5);
+		d = (1 << BLUR_FIXED_Q) + b1 + b2;
+		a0 = (int)std::floor(c.a0*q + 0.5);
+		a2 = (int)std::floor(c.a2*q + 0.5);
+		// a0+a1+a2+a3 == d, so the total DC gain is exactly 1
+		gp = (long long)std::floor(c.coefp*d + 0.5);
+		gn = d - gp;
+		a1 = (int)(gp - a0);
+		a3 = (int)(gn - a2);
+	}
+};
+
+/* One pass over n steps of M lanes, lane l of step i at			*/
+/* data[i*sstride + l*lstride], in place.  Y is scratch for n*M values.	*/
+
+template<int M>
+static BLUR_INLINE void deriche_fixed_lanes(const DericheFixed &c, unsigned char *data,
+                                            const long lstride, const long sstride, const int n, int *Y)
+{
+	const int half = 1 << (BLUR_FIXED_Q-1);
+	int xc[M], xp[M], yp[M], yb[M], xa[M];
+
+	for (int l = 0; l < M; l++)
+	{
+		xp[l] = data[l*lstride] << BLUR_FIXED_S;
+		yb[l] = yp[l] = (int)((c.gp*xp[l] + c.d/2)/c.d);
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		int *yc = Y + (size_t)i*M;
+		const unsigned char *src = data + i*sstride;
+		for (int l = 0; l < M; l++)
+			xc[l] = src[l*lstride] << BLUR_FIXED_S;
+		for (int l = 0; l < M; l++)
+		{
+			yc[l] = (c.a0*xc[l] + c.a1*xp[l] - c.b1*yp[l] - c.b2*yb[l] + half) >> BLUR_FIXED_Q;
+			xp[l] = xc[l];
+			yb[l] = yp[l];
+			yp[l] = yc[l];
+		}
+	}
+
+	// xp/yp/yb are xn/yn/ya from here
+	for (int l = 0; l < M; l++)
+	{
+		xa[l] = xp[l] = data[(n-1)*sstride + l*lstride] << BLUR_FIXED_S;
+		yb[l] = yp[l] = (int)((c.gn*xa[l] + c.d/2)/c.d);
+	}
+
+	for (int i = n-1; i >= 0; i--)
+	{
+		const int *yc = Y + (size_t)i*M;
+		unsigned char *dst = data + i*sstride;
+		for (int l = 0; l < M; l++)
+			xc[l] = dst[l*lstride] << BLUR_FIXED_S;
+		int r[M];
+		for (int l = 0; l < M; l++)
+		{
+			const int v = (c.a2*xp[l] + c.a3*xa[l] - c.b1*yp[l] - c.b2*yb[l] + half) >> BLUR_FIXED_Q;
+			xa[l] = xp[l];
+			xp[l] = xc[l];
+			yb[l] = yp[l];
+			yp[l] = v;
+			r[l] = std::min(std::max((yc[l] + v) >> BLUR_FIXED_S, 0), 255);
+		}
+		for (int l = 0; l < M; l++)
+			dst[l*lstride] = (unsigned char)r[l];
+	}
+}
+
+// lanes per group: rows in the horizontal, columns in the vertical pass
+const static int BLUR_ROW_LANES = 8;
+const static int BLUR_COL_LANES = 32;
+
+typedef void (*BlurLaneFunc)(const DericheFixed &c, unsigned char *data, const long lstride, const long sstride, const int n, int *Y);
+
+static void blur_rows_generic(const DericheFixed &c, unsigned char *data, const long lstride, const long sstride, const int n, int *Y)
+{
+	deriche_fixed_lanes<BLUR_ROW_LANES>(c, data, lstride, sstride, n, Y);
+}
+
+static void blur_cols_generic(const DericheFixed &c, unsigned char *data, const long lstride, const long sstride, const int n, int *Y)
+{
+	deriche_fixed_lanes<BLUR_COL_LANES>(c, data, lstride, sstride, n, Y);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLUR_X86 1
+
+__attribute__((target("avx2")))
+static void blur_rows_avx2(const DericheFixed &c, unsigned char *data, const long lstride, const long sstride, const int n, int *Y)
+{
+	deriche_fixed_lanes<BLUR_ROW_LANES>(c, data, lstride, sstride, n, Y);
+}
+
+__attribute__((target("avx2")))
+static void blur_cols_avx2(const DericheFixed &c, unsigned char *data, const long lstride, const long sstride, const int n, int *Y)
+{
+	deriche_fixed_lanes<BLUR_COL_LANES>(c, data, lstride, sstride, n, Y);
+}
+
+__attribute__((target("sse4.1")))
+static void blur_rows_sse41(const DericheFixed &c, unsigned char *data, const long lstride, const long sstride, const int n, int *Y)
+{
+	deriche_fixed_lanes<BLUR_ROW_LANES>(c, data, lstride, sstride, n, Y);
+}
+
+__attribute__((target("sse4.1")))
+static void blur_cols_sse41(const DericheFixed &c, unsigned char *data, const long lstride, const long sstride, const int n, int *Y)
+{
+	deriche_fixed_lanes<BLUR_COL_LANES>(c, data, lstride, sstride, n, Y);
+}
+#endif
+
+static void blur_single(const DericheFixed &c, unsigned char *data, const long lstride, const long sstride, const int n, int *Y)
+{
+	deriche_fixed_lanes<1>(c, data, lstride, sstride, n, Y);
+}
+
+struct BlurNoRule
+{
+	void operator()(unsigned char *) const {}
+};
+
+/* In place smoothing of an 8 bit mask, see above for the tolerance.	*/
+
+static void blur_mask(unsigned char *data, const int xsize, const int ysize, const float sigma)
+{
+	if (sigma < 0.1f)
+		return;
+
+	if (sigma > BLUR_FIXED_MAX_SIGMA)
+	{
+		unsigned char *layers[1] = { data };
+		const bool active[1] = { true };
+		BlurNoRule none;
+		blur_layers(layers, active, 1, xsize, ysize, sigma, none);
+		return;
+	}
+
+	BlurLaneFunc rows = blur_rows_generic;
+	BlurLaneFunc cols = blur_cols_generic;
+#ifdef BLUR_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		rows = blur_rows_avx2;
+		cols = blur_cols_avx2;
+	}
+	else if (__builtin_cpu_supports("sse4.1"))
+	{
+		rows = blur_rows_sse41;
+		cols = blur_cols_sse41;
+	}
+#endif
+
+	const DericheFixed c(sigma);
+
+	if (xsize > 1)
+	{
+#pragma omp parallel
+		{
+			std::vector<int> Y((size_t)xsize*BLUR_ROW_LANES);
+
+#pragma omp for schedule(static)
+			for (int y = 0; y < ysize; y += BLUR_ROW_LANES)
+			{
+				unsigned char *row = data + (size_t)y*xsize;
+				if (y + BLUR_ROW_LANES <= ysize)
+					rows(c, row, xsize, 1, xsize, &Y[0]);
+				else
+					for (int l = 0; l < ysize-y; l++)
+						blur_single(c, row + (size_t)l*xsize, 0, 1, xsize, &Y[0]);
+			}
+		}
+	}
+
+	if (ysize > 1)
+	{
+#pragma omp parallel
+		{
+			std::vector<int> Y((size_t)ysize*BLUR_COL_LANES);
+
+#pragma omp for schedule(static)
+			for (int x = 0; x < xsize; x += BLUR_COL_LANES)
+			{
+				if (x + BLUR_COL_LANES <= xsize)
+					cols(c, data + x, 1, xsize, ysize, &Y[0]);
+				else
+					for (int l = 0; l < xsize-x; l++)
+						blur_single(c, data + x + l, 0, xsize, ysize, &Y[0]);
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,2036 @@
+/* ========================================================================
+    File: @(#)coastline.cpp
+   ------------------------------------------------------------------------
+    coastline_gen simple coastline generalization - library
+    Copyright (C) 2012-2013 Christoph Hormann <chris_hormann@gmx.de>
+   ------------------------------------------------------------------------
+
+    This file is part of coastline_gen
+
+    coastline_gen is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    coastline_gen is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with coastline_gen.  If not, see <http://www.gnu.org/licenses/>.
+
+    Version history:
+
+      0.3: initial public version, February 2013
+      0.4: internal, unpublished
+      0.5: adding connection and collapse mask support, August 2013
+
+   ========================================================================
+ */
+
+#include <list>
+#include <deque>
+#include <cstring>
+#include <unistd.h>
+
+#include "coastline.h"
+#include "bitmask.h"
+#include "blur.h"
+#include "occupancy.h"
+#include "coastline_cimg.h"
+#include "debug.h"
+#include "stages.h"
+
+Parameters::Parameters():
+	Level(0.5), SLevel(0.5), ILevel(0.06), FS(1), FR(2),
+	NGConnected(false), FConRad(0), XCon(false), BlockSize(0), Debug(false),
+	DebugImages(NULL)
+{
+	const Rect all = { 0, 0, -1, -1 };
+	DebugWindow = all;
+	const float r[8] = { 4.0, 2.5, 1.0, 0.5, 1.0, 0.0, 0.0, 0.0 };
+	const int t[4] = { 8, 16, 36, 120 };
+	std::copy(r, r+8, Radius);
+	std::copy(t, t+4, IThr);
+}
+
+// skeleton layers dilated together, see DilationRule
+enum { SKEL_L, SKEL_W, SKEL_L2, SKEL_W2, SKEL_WX, SKEL_LX, SKEL_LAYERS };
+
+// thresholds after every skeleton dilation step: land and water skeletons
+// compete, the secondary skeletons (sl2/sw2) and the base skeletons (swx/slx)
+// only take part while they are dilated
+struct DilationRule
+{
+	bool Secondary;
+	bool WaterBase;
+	bool LandBase;
+
+	void operator()(unsigned char *v) const
+	{
+		if (WaterBase && (v[SKEL_WX] > 10))
+			v[SKEL_WX] = 255;
+		if (LandBase && (v[SKEL_LX] > 10))
+			v[SKEL_LX] = 255;
+
+		if ((v[SKEL_L] > 10) && (v[SKEL_L] > v[SKEL_W]))
+			v[SKEL_L] = 255;
+		else
+			v[SKEL_L] = 0;
+
+		if (Secondary)
+		{
+			if ((v[SKEL_L2] > 10) && (v[SKEL_L2] > v[SKEL_W]) && (v[SKEL_L2] > v[SKEL_W2]))
+				v[SKEL_L2] = 255;
+			else
+				v[SKEL_L2] = 0;
+		}
+
+		if ((v[SKEL_W] > 10) && (v[SKEL_W] > v[SKEL_L]) && (v[SKEL_W] > v[SKEL_L2]))
+			v[SKEL_W] = 255;
+		else
+			v[SKEL_W] = 0;
+
+		if (Secondary)
+		{
+			if ((v[SKEL_W2] > 10) && (v[SKEL_W2] > v[SKEL_L]) && (v[SKEL_W2] > v[SKEL_L2]))
+				v[SKEL_W2] = 255;
+			else
+				v[SKEL_W2] = 0;
+		}
+	}
+};
+
+// pool of full size scratch images shared by the stages of generalize().  A
+// stage takes an image when its lifetime starts and gives it back when it
+// ends, so later stages reuse the memory instead of allocating (and page
+// faulting) it again.
+template<typename T>
+class ScratchPool
+{
+public:
+	// img receives a pooled image of the given size
+	void take(CImg<T> &img, const int xsize, const int ysize)
+	{
+		if (!pool.empty())
+		{
+			img.swap(pool.back());
+			pool.pop_back();
+		}
+		img.assign(xsize, ysize, 1, 1);
+	}
+
+	void give(CImg<T> &img)
+	{
+		if (img.is_empty()) return;
+		pool.push_back(CImg<T>());
+		pool.back().swap(img);
+	}
+
+private:
+	std::list< CImg<T> > pool;
+};
+
+// the last distance fields computed, keyed by their feature pixels, so
+// parameter sets of run_batch() requesting the same field can share it.
+// Shared by concurrently processed sets.
+class DistanceCache
+{
+public:
+	DistanceCache(): capacity(0), hits(0) {}
+
+	// keeps up to n fields, 0 disables the cache
+	void reset(const int n)
+	{
+		capacity = n;
+		hits = 0;
+		entries.clear();
+	}
+
+	bool is_enabled() const { return capacity > 0; }
+	int reused() const { return hits; }
+
+	bool find(const BitMask &key, CImg<unsigned int> &dist2)
+	{
+		bool found = false;
+#pragma omp critical(distance_cache)
+		for (std::list<Entry>::iterator i = entries.begin(); i != entries.end(); ++i)
+			if (i->key == key)
+			{
+				dist2 = i->dist2;
+				entries.splice(entries.begin(), entries, i);
+				hits++;
+				found = true;
+				break;
+			}
+		return found;
+	}
+
+	void insert(const BitMask &key, const CImg<unsigned int> &dist2)
+	{
+#pragma omp critical(distance_cache)
+		{
+			entries.push_front(Entry());
+			entries.front().key = key;
+			entries.front().dist2 = dist2;
+			if ((int)entries.size() > capacity)
+				entries.pop_back();
+		}
+	}
+
+private:
+	struct Entry
+	{
+		BitMask key;
+		CImg<unsigned int> dist2;
+	};
+
+	int capacity;
+	int hits;
+	std::list<Entry> entries;
+};
+
+struct Scratch
+{
+	ScratchPool<unsigned char> u8;
+	ScratchPool<unsigned int> u32;
+	ScratchPool<int> i32;
+	DistanceCache *cache;
+	DebugWriter *debug;
+
+	Scratch(): cache(NULL), debug(NULL) {}
+
+	// squared distance to the pixels of img with value val
+	void distance2(const CImg<unsigned char> &img, const unsigned char val, CImg<unsigned int> &dist2)
+	{
+		u32.take(dist2, img.width(), img.height());
+
+		BitMask key;
+		if ((cache != NULL) && cache->is_enabled())
+		{
+			key.assign_range(img.data(), img.width(), img.height(), val, val);
+			if (cache->find(key, dist2))
+				return;
+		}
+
+		CImg<int> ft;
+		i32.take(ft, img.width(), img.height());
+		img.distance2(val, dist2, ft);
+		i32.give(ft);
+
+		if ((cache != NULL) && cache->is_enabled())
+			cache->insert(key, dist2);
+	}
+
+	// disk dilation of img with pooled distance buffers, erosions use
+	// the distance fields of distance2()
+	void dilate_disk(CImg<unsigned char> &img, const float r)
+	{
+		CImg<unsigned int> dist2;
+		CImg<int> ft;
+		u32.take(dist2, img.width(), img.height());
+		i32.take(ft, img.width(), img.height());
+		img.dilate_disk(r, dist2, ft);
+		i32.give(ft);
+		u32.give(dist2);
+	}
+};
+
+// smallest squared distance n with sqrt(n) >= r (> r if strict), allows
+// comparing squared integer distances the same way as the float distances
+// from CImg get_distance()
+static unsigned int dist2_threshold(const float r, const bool strict = false)
+{
+	unsigned int n = (r > 1) ? (unsigned int)((r-1)*(r-1)) : 0;
+	while (strict ? !(std::sqrt((float)n) > r) : !(std::sqrt((float)n) >= r))
+		n++;
+	return n;
+}
+
+// radius independent results of the first stages of generalize(), valid
+// for all parameters with the same FS, FR, NGConnected, FConRad and XCon
+struct Preprocessed
+{
+	CImg<unsigned char> img_m;
+	CImg<unsigned char> img_f;
+	CImg<unsigned char> img_b;
+	bool Trivial;
+};
+
+// first stages of generalize(): preprocesses the fixed mask img_f (if not
+// empty), binarizes img_m and sets img_b to the land layer.  Returns false
+// if the data is trivial (no land or no water).
+static bool preprocess(CImg<unsigned char> &img_m, CImg<unsigned char> &img_f, CImg<unsigned char> &img_b, const Parameters &P, Scratch &scratch, Profile &Prof)
+{
+	const int FS = P.FS;
+	const int FR = P.FR;
+	const bool NGConnected = P.NGConnected;
+	const int FConRad = P.FConRad;
+	const bool XCon = P.XCon;
+	const bool Debug = P.Debug && (scratch.debug != NULL);
+
+	const bool HasFixed = !img_f.is_empty();
+	const size_t npx = img_m.size();
+
+	Prof.begin("fixed_mask", npx);
+
+	if (HasFixed)
+	{
+		std::fprintf(stderr,"Preprocessing fixed mask data...\n");
+
+		// repel
+		if (FS > 0)
+		{
+			int cnte = 0;
+			int cnte2 = 0;
+			int cnte3 = 0;
+			int cnte4 = 0;
+
+			CImg<unsigned char> img_e;
+			scratch.u8.take(img_e, img_m.width(), img_m.height());
+
+			cimg_forXY(img_e,px,py)
+				img_e(px,py) = 0;
+
+			// distance to the fixed area, img_f is not changed before the
+			// erosion by FR so the field is also used there
+			CImg<unsigned int> img_fd;
+
+			// expand connected areas
+			if (NGConnected && (FConRad == 0))
+			{
+				cimg_forXY(img_m,px,py)
+				{
+					if (img_m(px,py) == 255)
+					{
+						img_e(px,py) = 255;
+						for (int i = 1; i < 9; i++)
+						{
+							int xn = px + xo[i];
+							int yn = py + yo[i];
+							if (xn >= 0)
+								if (yn >= 0)
+									if (xn < img_m.width())
+										if (yn < img_m.height())
+											if (img_f(xn,yn) == 0)
+												if (img_m(xn,yn) != 255)
+												{
+													img_e(xn,yn) = 128;
+													cnte++;
+												}
+						}
+					}
+				}
+			}
+
+			// fix connections to fixed areas
+			if (FConRad > 0)
+			{
+				cimg_forXY(img_m,px,py)
+				{
+					if (img_m(px,py) == 255)
+					if (img_f(px,py) == 0)
+					if (img_e(px,py) == 0)
+					{
+						for (int i = 1; i < 9; i++)
+						{
+							int xn = px + xo[i];
+							int yn = py + yo[i];
+							if (xn >= 0)
+								if (yn >= 0)
+									if (xn < img_m.width())
+										if (yn < img_m.height())
+											if (img_f(xn,yn) != 0)
+												if (img_m(xn,yn) != 0)
+												if (img_m(xn,yn) != 255)
+												{
+													img_e(xn,yn) = 128;
+													img_m(xn,yn) = 255;
+													cnte4++;
+												}
+						}
+					}
+				}
+
+				cimg_forXY(img_m,px,py)
+				{
+					if (img_e(px,py) == 128)
+					{
+						for (int i = 1; i < 9; i++)
+						{
+							int xn = px + xo[i];
+							int yn = py + yo[i];
+							if (xn >= 0)
+								if (yn >= 0)
+									if (xn < img_m.width())
+										if (yn < img_m.height())
+											if (img_f(xn,yn) != 0)
+												if (img_m(xn,yn) != 0)
+												if (img_m(xn,yn) != 255)
+												{
+													img_e(xn,yn) = 80;
+													img_m(xn,yn) = 255;
+													cnte4++;
+												}
+						}
+					}
+				}
+
+				// look for nearest fixed within radius
+				// A connection pixel at distance dist from the fixed area is
+				// connected in round d = ceil(dist), to the first fixed pixel in
+				// scan order within radius d, unless an earlier connection line
+				// already went through it. The distance transform yields d
+				// directly and the first fixed pixel of a disk row is looked up
+				// in a per-row successor table, so no round rescans the image.
+				{
+					scratch.distance2(img_f, 0, img_fd);
+					CImg<int> img_fn;
+					scratch.i32.take(img_fn, img_f.width(), img_f.height());
+					cimg_forY(img_f,py)
+					{
+						int next = -1;
+						for (int px = img_f.width()-1; px >= 0; px--)
+						{
+							if (img_f(px,py) == 0)
+								next = px;
+							img_fn(px,py) = next;
+						}
+					}
+
+					std::vector< std::vector<size_t> > sources(FConRad+1);
+					cimg_forXY(img_m,px,py)
+					{
+						if (img_m(px,py) == 255)
+						if (img_f(px,py) != 0)
+						if (img_fd(px,py) <= (unsigned int)(FConRad*FConRad))
+						{
+							int d = (int)std::sqrt((double)img_fd(px,py));
+							while ((unsigned int)(d*d) < img_fd(px,py))
+								d++;
+							sources[d].push_back(px + (size_t)py*img_m.width());
+						}
+					}
+
+					for (int d=1; d <= FConRad; d++)
+					{
+						for (size_t i = 0; i < sources[d].size(); i++)
+						{
+							const int px = sources[d][i] % img_m.width();
+							const int py = sources[d][i] / img_m.width();
+							if (img_m(px,py) != 255)
+								continue;
+							for (int yn = std::max(0, py-d); yn <= std::min(img_m.height()-1, py+d); yn++)
+							{
+								int dx = (int)std::sqrt((double)(d*d - (py-yn)*(py-yn)));
+								while ((dx+1)*(dx+1) + (py-yn)*(py-yn) <= d*d)
+									dx++;
+								while (dx*dx + (py-yn)*(py-yn) > d*d)
+									dx--;
+								const int xn = img_fn(std::max(0, px-dx), yn);
+								if ((xn >= 0) && (xn <= px+dx))
+								{
+									unsigned char v = 180;
+									img_e.draw_line(px, py, xn, yn, &v);
+									v = 254;
+									img_m.draw_line(px, py, xn, yn, &v);
+									cnte2++;
+									break;
+								}
+							}
+						}
+					}
+
+					scratch.i32.give(img_fn);
+				}
+
+				cimg_forXY(img_m,px,py)
+				{
+					if ((img_m(px,py) == 255) || (img_e(px,py) > 64))
+					{
+						for (int i = 1; i < 9; i++)
+						{
+							int xn = px + xo[i];
+							int yn = py + yo[i];
+							if (xn >= 0)
+								if (yn >= 0)
+									if (xn < img_m.width())
+										if (yn < img_m.height())
+											if (img_f(xn,yn) == 0)
+												if (img_m(xn,yn) != 255)
+												{
+													img_e(xn,yn) = 64;
+													img_m(xn,yn) = 254;
+													cnte3++;
+												}
+						}
+					}
+				}
+
+				if (XCon)
+					cimg_forXY(img_m,px,py)
+					{
+						if (img_e(px,py) == 64)
+						{
+							for (int i = 1; i < 9; i++)
+							{
+								int xn = px + xo[i];
+								int yn = py + yo[i];
+								if (xn >= 0)
+									if (yn >= 0)
+										if (xn < img_m.width())
+											if (yn < img_m.height())
+												if (img_f(xn,yn) == 0)
+													if (img_m(xn,yn) != 255)
+													{
+														img_e(xn,yn) = 32;
+														img_m(xn,yn) = 254;
+														cnte2++;
+													}
+							}
+						}
+					}
+
+				cimg_forXY(img_m,px,py)
+				{
+					if (img_m(px,py) == 254)
+						img_m(px,py) = 255;
+				}
+			}
+
+			if (Debug)
+				scratch.debug->save(img_e, "debug-em.tif");
+
+			std::fprintf(stderr,"  %d/%d/%d/%d pixels expanded\n", cnte, cnte2, cnte3, cnte4);
+
+			if (img_fd.is_empty())
+				scratch.distance2(img_f, 0, img_fd);
+			img_b = img_f;
+			img_b.erode_disk(FR, img_fd);
+			scratch.u32.give(img_fd);
+
+			cimg_forXY(img_f,px,py)
+			{
+				if (img_f(px,py) > 0)
+				{
+					if (img_b(px,py) == 0)
+					{
+						img_f(px,py) = 128;
+						if (img_m(px,py) < 255)
+							img_m(px,py) = 0;
+					}
+					else
+						img_f(px,py) = 255;
+				}
+
+				if (img_m(px,py) > 0)
+				{
+					if (img_m(px,py) < 255)
+					{
+						if (img_f(px,py) < 255)
+							img_f(px,py) = 64;
+						img_m(px,py) = 255;
+					}
+					else
+					{
+						img_f(px,py) = 255;
+					}
+				}
+				img_b(px,py) = img_m(px,py);
+			}
+
+			if (NGConnected)
+			{
+				cimg_forXY(img_m,px,py)
+				{
+					if (img_e(px,py) != 0)
+					{
+						img_f(px,py) = 254;
+					}
+				}
+			}
+
+			scratch.u8.give(img_e);
+		}
+		else // attract
+		{
+			cimg_forXY(img_m,px,py)
+			{
+				if (img_m(px,py) > 0)
+					img_m(px,py) = 255;
+			}
+
+			img_b = img_m;
+
+			// water pixels with both active fixed and land within FR
+			CImg<unsigned int> img_fd;
+			CImg<unsigned int> img_md;
+			scratch.distance2(img_f, 0, img_fd);
+			scratch.distance2(img_b, 255, img_md);
+			const unsigned int FR2 = (FR > 0) ? FR*FR : 0;
+
+			cimg_forXY(img_f,px,py)
+			{
+				if ((img_b(px,py) == 0) && (img_f(px,py) != 0))
+				{
+					const bool found_m = (FR > 0) && (img_md(px,py) <= FR2);
+					const bool found_f = (FR > 0) && (img_fd(px,py) <= FR2);
+
+					if (found_m && found_f)
+					{
+						img_m(px,py) = 255;
+						for (int i = 1; i < 9; i++)
+						{
+							int xn = px + xo[i];
+							int yn = py + yo[i];
+							if (xn >= 0)
+								if (yn >= 0)
+									if (xn < img_f.width())
+										if (yn < img_f.height())
+											img_m(xn,yn) = 255;
+						}
+					}
+				}
+			}
+
+			scratch.u32.give(img_fd);
+			scratch.u32.give(img_md);
+
+			img_b = img_m;
+		}
+
+		if (Debug)
+		{
+			scratch.debug->save(img_f, "debug-f.pgm");
+			scratch.debug->save(img_m, "debug-fm.pgm");
+		}
+	}
+	else
+	{
+		cimg_forXY(img_m,px,py)
+		{
+			if (img_m(px,py) > 0)
+				img_m(px,py) = 255;
+		}
+		img_b = img_m;
+	}
+
+	Prof.begin("measure_land", npx);
+	std::fprintf(stderr,"Measuring land areas...\n");
+
+	size_t cnt_all = 0;
+	size_t cnt_land = 0;
+
+	cimg_forXY(img_b,px,py)
+	{
+		cnt_all++;
+		if (img_b(px,py) == 255)
+			cnt_land++;
+	}
+
+	return (cnt_land != cnt_all) && (cnt_land != 0);
+
+}
+
+// data of the stages of generalize() run in a StageGraph
+enum
+{
+	RES_SL = 1,     // land skeleton img_sl
+	RES_SW = 2,     // water skeleton img_sw
+	RES_PL = 4,     // prune depth of the land skeleton
+	RES_PW = 8,     // prune depth of the water skeleton
+	RES_D = 16,     // debug image img_d
+	RES_CL = 32,    // neighborhood codes of the land skeleton
+	RES_CW = 64     // neighborhood codes of the water skeleton
+};
+
+// land or water half of the skeletonization: the layer eroded by the
+// normal radius is fixed (255), the rest of the layer variable (128)
+struct SkeletonBranch
+{
+	bool Land;
+	const BitMask *mm;              // land pixels
+	const BitMask *mf;              // fixed mask pixels or NULL
+	unsigned int Erosion;
+	CImg<unsigned char> *img_s;     // the skeleton
+	CImg<unsigned char> *codes;     // neighborhood codes of the skeleton
+	CImg<unsigned char> *img_d;     // debug image or NULL
+	DebugWriter *debug;             // NULL without debug output
+	int cnt_fixed;
+	int cnt_variable;
+};
+
+// classifies and thins the layer of a SkeletonBranch
+class SkeletonStage: public StageGraph::Stage
+{
+public:
+	SkeletonStage(SkeletonBranch &branch): b(branch) {}
+
+	void run()
+	{
+		CImg<unsigned char> &img_s = *b.img_s;
+		const BitMask &mm = *b.mm;
+
+		BitMask m = mm;
+		if (!b.Land) m.invert();
+		m.erode(b.Erosion);
+		if (b.mf != NULL)
+		{
+			if (b.Land) m.and_not(*b.mf);
+			else m |= *b.mf;
+		}
+
+		img_s.assign(mm.width(), mm.height(), 1, 1);
+
+		if (b.debug != NULL)
+		{
+			m.to_bytes(img_s.data(), 255);
+			b.debug->save(img_s, b.Land ? "debug-raw-l.pgm" : "debug-raw-w.pgm");
+		}
+
+		b.cnt_fixed = 0;
+		b.cnt_variable = 0;
+		cimg_forXY(img_s,px,py)
+		{
+			if ((px > 1) && (py > 1) && (px < img_s.width()-2) && (py < img_s.height()-2))
+			{
+				if (m.get(px,py))
+				{
+					img_s(px,py) = 255;
+					b.cnt_fixed++;
+				}
+				else if (mm.get(px,py) == b.Land)
+				{
+					img_s(px,py) = 128;
+					b.cnt_variable++;
+				}
+				else
+					img_s(px,py) = 0;
+			}
+			else
+				img_s(px,py) = 0;
+		}
+
+		img_s.thin_queue(200, true);
+
+		if (b.debug != NULL)
+			b.debug->save(img_s, b.Land ? "debug-skel-l.pgm" : "debug-skel-w.pgm");
+	}
+
+private:
+	SkeletonBranch &b;
+};
+
+// reduces the variable pixels of a thinned SkeletonBranch to those with at
+// least two skeleton neighbors, marks all of them in the debug image.  The
+// neighborhood codes are computed for the thinned skeleton and afterwards
+// for the reduced one, these are used for pruning.
+class JunctionStage: public StageGraph::Stage
+{
+public:
+	JunctionStage(SkeletonBranch &branch): b(branch) {}
+
+	void run()
+	{
+		CImg<unsigned char> &img_s = *b.img_s;
+		CImg<unsigned char> &codes = *b.codes;
+
+		img_s.neighbor_codes(codes);
+
+		if (b.img_d != NULL)
+		{
+			CImg<unsigned char> &img_d = *b.img_d;
+			const unsigned char v = b.Land ? 128 : 80;
+			cimg_forXY(img_s,px,py)
+				if (img_s(px,py) == 128)
+					img_d(px,py) = v;
+		}
+
+		cimg_forXY(img_s,px,py)
+			img_s(px,py) = ((img_s(px,py) == 128) && (code_adj[codes(px,py)] >= 2)) ? 128 : 0;
+
+		img_s.neighbor_codes(codes);
+	}
+
+private:
+	SkeletonBranch &b;
+};
+
+// end point removal depth of a skeleton with its neighborhood codes (which
+// are modified), see get_prune_depth()
+class PruneStage: public StageGraph::Stage
+{
+public:
+	PruneStage(const CImg<unsigned char> &skeleton, CImg<unsigned char> &neighbors, const int depth, CImg<unsigned short> &result):
+		img_s(skeleton), codes(neighbors), maxdepth(depth), img_p(result) {}
+
+	void run() { img_p = img_s.get_prune_depth(maxdepth, codes); }
+
+private:
+	const CImg<unsigned char> &img_s;
+	CImg<unsigned char> &codes;
+	const int maxdepth;
+	CImg<unsigned short> &img_p;
+};
+
+// generalizes the land water mask img_m in place, img_f (fixed mask) and
+// img_co (collapse mask) are optional and can be empty, both are modified.
+// With pre the first stages are skipped and img_m and img_f are replaced by
+// their preprocessed versions.  The temporary images are taken from
+// scratch, the stages are recorded in Prof.
+static void generalize(CImg<unsigned char> &img_m, CImg<unsigned char> &img_f, CImg<unsigned char> &img_co, const Parameters &P, Scratch &scratch, Profile &Prof, const Preprocessed *pre = NULL)
+{
+	const float Level = P.Level;
+	const float SLevel = P.SLevel;
+	const float ILevel = P.ILevel;
+	const int FS = P.FS;
+	const float *Radius = P.Radius;
+	const int *IThr = P.IThr;
+	const bool Debug = P.Debug && (scratch.debug != NULL);
+
+	if (pre != NULL)
+		img_f = pre->img_f;
+
+	const bool HasFixed = !img_f.is_empty();
+	const bool HasCollapse = !img_co.is_empty();
+
+	// full size buffers living across stages:
+	//   img_b           working layer, reused by every stage
+	//   img_il          island labels, from measuring islands to the end
+	//   img_sl, img_sw  skeletons, from skeletonization to the final assembly
+	//   img_d           debug image, only allocated with Debug
+	// the temporaries of the stages are taken from and given back to scratch
+	CImg<unsigned char> img_sl;
+	CImg<unsigned char> img_sw;
+	CImg<unsigned char> img_b;
+	CImg<unsigned char> img_d;
+	CImg<unsigned int> img_il;
+
+	const size_t npx = img_m.size();
+
+	img_sw = CImg<unsigned char>(img_m.width(), img_m.height(), 1, 1);
+	if (Debug)
+		img_d = CImg<unsigned char>(img_m.width(), img_m.height(), 1, 1);
+
+	bool Trivial;
+	if (pre != NULL)
+	{
+		img_m = pre->img_m;
+		img_b = pre->img_b;
+		Trivial = pre->Trivial;
+	}
+	else
+		Trivial = !preprocess(img_m, img_f, img_b, P, scratch, Prof);
+
+	if (Trivial)
+	{
+		std::fprintf(stderr,"  data is trivial\n");
+		Prof.end();
+		return;
+	}
+
+	if (Debug)
+	{
+		cimg_forXY(img_b,px,py)
+			img_d(px,py) = (img_b(px,py) == 255) ? 48 : 0;
+		scratch.debug->save(img_d, "debug-dx.pgm");
+	}
+
+	int cntie = 0;
+	int cntie2 = 0;
+
+	Prof.begin("measure_islands", npx);
+	std::fprintf(stderr,"Measuring islands...\n");
+
+	// measure islands, island_c holds the size class of every island: 0 if
+	// removed, 1 if to be connected to the main land and the area otherwise
+	std::vector<ComponentStats> islands;
+	const size_t n_islands = img_b.label4(255, img_il, islands);
+	std::vector<int> island_c(n_islands+1, 0);
+
+	for (size_t i = 1; i <= n_islands; i++)
+	{
+		const int c = (int)std::min(islands[i].area, (size_t)INT_MAX);
+		if (c < IThr[0])
+			cntie++;
+		else if (c < IThr[1])
+		{
+			island_c[i] = 1;
+			cntie2++;
+		}
+		else
+			island_c[i] = c;
+	}
+
+	// mark islands if too small
+	cimg_forXY(img_b,px,py)
+	{
+		if (img_il(px,py) != 0)
+		{
+			const size_t c = islands[img_il(px,py)].area;
+			if (c < (size_t)IThr[0])
+			{
+				img_b(px,py) = 64;
+				img_m(px,py) = 0;
+			}
+			else if (c < (size_t)IThr[1])
+			{
+				img_b(px,py) = 160;
+				img_m(px,py) = 0;
+			}
+			else
+				img_b(px,py) = 128;
+		}
+	}
+
+	if (Debug)
+		scratch.debug->save(img_b, "debug-ib.pgm");
+
+	std::fprintf(stderr,"  found %d/%d small islands.\n", cntie, cntie2);
+
+	if ((Radius[5] > 0.1) || (Radius[6] > 0.1))
+	{
+		Prof.begin("collapse", npx);
+		std::fprintf(stderr,"Collapsing thin features (%.2f/%.2f/%.2f)...\n", Radius[5], Radius[6], Radius[7]);
+
+		const int xsize = img_b.width();
+		const int ysize = img_b.height();
+
+		// land pixels: 180 if closer than Radius[7] to water, 128 if
+		// connected to a pixel further away and 255 otherwise
+		CImg<unsigned char> img_e2;
+		// land pixels: 128 if connected to a pixel further than Radius[5]
+		// from water, 255 otherwise
+		CImg<unsigned char> img_ex;
+		// land further than Radius[6]*8 from the land eroded by Radius[6]
+		BitMask mfar(xsize, ysize);
+
+		{
+			// distance to water, also used for the erosion by Radius[6]
+			CImg<unsigned int> img_dist;
+			scratch.distance2(img_b, 0, img_dist);
+
+			const unsigned int d2_7 = dist2_threshold(Radius[7]);
+
+			scratch.u8.take(img_e2, xsize, ysize);
+			cimg_forXY(img_b,px,py)
+			{
+				if (img_b(px,py) > 0)
+					img_e2(px,py) = (img_dist(px,py) < d2_7) ? 180 : 255;
+				else
+					img_e2(px,py) = 0;
+			}
+
+			cimg_forXY(img_b,px,py)
+			{
+				if (img_e2(px,py) == 255)
+					if (img_dist(px,py) >= d2_7)
+						img_e2.floodfill4(px, py, 255, 128);
+			}
+
+			if (Radius[5] > 0.1)
+			{
+				const unsigned int d2_5 = dist2_threshold(Radius[5]);
+
+				scratch.u8.take(img_ex, xsize, ysize);
+				cimg_forXY(img_b,px,py)
+					img_ex(px,py) = (img_b(px,py) > 0) ? 255 : 0;
+
+				cimg_forXY(img_b,px,py)
+				{
+					if (img_ex(px,py) == 255)
+						if (img_dist(px,py) >= d2_5)
+							img_ex.floodfill4(px, py, 255, 128);
+				}
+			}
+
+			CImg<unsigned char> img_e;
+			scratch.u8.take(img_e, xsize, ysize);
+			img_e.erode_disk(Radius[6], img_dist);
+
+			if (Debug)
+				scratch.debug->save(img_e, "debug-cl-e.tif");
+
+			const unsigned int d2_6 = dist2_threshold(Radius[6]*8.0, true);
+
+			scratch.distance2(img_e, 255, img_dist);
+			cimg_forXY(img_b,px,py)
+				if (img_dist(px,py) >= d2_6)
+					mfar.set(px,py);
+
+			scratch.u8.give(img_e);
+			scratch.u32.give(img_dist);
+		}
+
+		// disable collapse according to collapse mask
+		if (HasCollapse)
+		{
+			scratch.dilate_disk(img_co, Radius[6]);
+		}
+
+		if (Debug)
+			scratch.debug->save(img_e2, "debug-cl-e2.tif");
+
+		int cntc = 0;
+		int cntc2 = 0;
+		int cntc3 = 0;
+
+		// collapse thin features
+		cimg_forXY(img_m,px,py)
+		{
+			if (img_b(px,py) == 0) continue;
+
+			if (Radius[5] > 0.1)
+			{
+				if (img_ex(px,py) != 128)
+				{
+					img_b(px,py) = 0;
+					img_m(px,py) = 0;
+					img_il(px,py) = 0;
+					if (Debug) img_d(px,py) = 64;
+					cntc++;
+				}
+			}
+			if (mfar.get(px,py))
+			{
+				if (HasCollapse)
+				{
+					if (img_co(px,py) != 0)
+					{
+						img_b(px,py) = 0;
+						img_m(px,py) = 0;
+						img_il(px,py) = 0;
+						if (Debug) img_d(px,py) = 128;
+						cntc2++;
+					}
+				}
+				else
+				{
+					img_b(px,py) = 0;
+					img_m(px,py) = 0;
+					img_il(px,py) = 0;
+					if (Debug) img_d(px,py) = 128;
+					cntc2++;
+				}
+			}
+			if (img_e2(px,py) != 128)
+			//if ((img_e2(px,py) != 180) && (img_dist(px,py) > Radius[6]))
+			{
+				if (HasCollapse)
+				{
+					//if (island_c[img_il(px,py)] >= IThr[3])
+					if (img_co(px,py) != 0)
+					{
+						img_b(px,py) = 0;
+						img_m(px,py) = 0;
+						img_il(px,py) = 0;
+						if (Debug) img_d(px,py) = 128;
+						cntc3++;
+					}
+				}
+				else //if (island_c[img_il(px,py)] >= IThr[3])
+				{
+					img_b(px,py) = 0;
+					img_m(px,py) = 0;
+					img_il(px,py) = 0;
+					if (Debug) img_d(px,py) = 128;
+					cntc3++;
+				}
+			}
+		}
+
+		scratch.u8.give(img_e2);
+		scratch.u8.give(img_ex);
+
+		if (Debug)
+			scratch.debug->save(img_d, "debug-dcl.tif");
+
+		std::fprintf(stderr,"  %d/%d pixels collapsed.\n", cntc, cntc2, cntc3);
+	}
+
+	Prof.begin("connect_islands", npx);
+	std::fprintf(stderr,"Analyzing small islands...\n");
+
+	cntie = 0;
+	int cxx = 0;
+
+	{
+		// pixels of the islands to connect in scan order and the smallest
+		// ring distance at which main land can be found according to the
+		// distance transform, main land further away than Radius[1] is never
+		// reached
+		CImg<unsigned int> img_md;
+		scratch.distance2(img_m, 255, img_md);
+
+		std::vector<int> cand_x;
+		std::vector<int> cand_y;
+		std::vector<int> cand_d;
+
+		cimg_forXY(img_b,px,py)
+		{
+			if (island_c[img_il(px,py)] == 1)
+			{
+				const unsigned int d2 = img_md(px,py);
+				int dmin = INT_MAX;
+				if (std::sqrt((double)d2) <= Radius[1])
+				{
+					dmin = std::max(1, int(std::sqrt(d2*0.5)));
+					while (2.0*dmin*dmin < d2) dmin++;
+				}
+				cand_x.push_back(px);
+				cand_y.push_back(py);
+				cand_d.push_back(dmin);
+			}
+		}
+
+		scratch.u32.give(img_md);
+
+		// next main land pixel of every row at or right of each position,
+		// -1 if there is none
+		CImg<int> img_mn;
+		scratch.i32.take(img_mn, img_m.width(), img_m.height());
+		cimg_forY(img_m,py)
+		{
+			int next = -1;
+			for (int px = img_m.width()-1; px >= 0; px--)
+			{
+				if (img_m(px,py) == 255)
+					next = px;
+				img_mn(px,py) = next;
+			}
+		}
+
+		// look for nearest main land: the first main land pixel within
+		// Radius[1] in scan order on the square ring of distance d.  The top
+		// and bottom row of the ring are looked up in img_mn, the other rows
+		// only contribute their two end pixels.
+		for (int d=1; d < Radius[1]-0.0001; d++)
+		{
+			// half width of the top and bottom row within Radius[1]
+			int e = std::min(d, (int)std::sqrt(std::max(0.0, (double)Radius[1]*Radius[1] - d*d)));
+			while ((e < d) && (std::sqrt((double)((e+1)*(e+1) + d*d)) <= Radius[1]))
+				e++;
+			while ((e >= 0) && (std::sqrt((double)(e*e + d*d)) > Radius[1]))
+				e--;
+
+			for (size_t i = 0; i < cand_x.size(); i++)
+			{
+				const int px = cand_x[i];
+				const int py = cand_y[i];
+				if (island_c[img_il(px,py)] == 1)
+				if (img_b(px,py) == 160)
+				{
+					if (d >= cand_d[i])
+					for (int yn = std::max(0, py-d); yn <= std::min(img_b.height()-1, py+d); yn++)
+					{
+						int xn = -1;
+						if ((yn == py-d) || (yn == py+d))
+						{
+							if ((e >= 0) && (px+e >= 0) && (px-e < img_b.width()))
+							{
+								xn = img_mn(std::max(0, px-e), yn);
+								if (xn > px+e) xn = -1;
+							}
+							cxx++;
+						}
+						else if (std::sqrt((double)(d*d + (py-yn)*(py-yn))) <= Radius[1])
+						{
+							if ((px-d >= 0) && (img_m(px-d,yn) == 255))
+								xn = px-d;
+							else if ((px+d < img_b.width()) && (img_m(px+d,yn) == 255))
+								xn = px+d;
+							cxx += 2;
+						}
+
+						if (xn >= 0)
+						{
+							img_b.floodfill4(px, py, 160, 180);
+							img_il.floodfill4(px, py, img_il(px,py), 0);
+							const unsigned char v = 255;
+							img_b.draw_line(px, py, xn, yn, &v);
+							img_b.draw_line(px+1, py, xn+1, yn, &v);
+							img_b.draw_line(px-1, py, xn-1, yn, &v);
+							cntie++;
+							break;
+						}
+					}
+				}
+				else
+				{
+					img_b(px,py) = std::min(96, (int)img_b(px,py));
+				}
+			}
+		}
+
+		scratch.i32.give(img_mn);
+	}
+
+	// transfer to main image
+	cimg_forXY(img_b,px,py)
+	{
+		if (img_b(px,py) > 128)
+		{
+			img_m(px,py) = 255;
+			if (Debug) img_d(px,py) = 255;
+		}
+	}
+
+	if (Debug)
+		scratch.debug->save(img_b, "debug-ib2.pgm");
+
+	std::fprintf(stderr,"  connected %d small islands (%d tests).\n", cntie, cxx);
+
+	Prof.begin("skeletonize", npx);
+	std::fprintf(stderr,"Preparing skeletonization...\n");
+
+	// neighborhood codes of the skeletons from junction marking to pruning
+	CImg<unsigned char> img_cl, img_cw;
+	scratch.u8.take(img_cl, img_m.width(), img_m.height());
+	scratch.u8.take(img_cw, img_m.width(), img_m.height());
+
+	{
+		BitMask mm;
+		mm.assign_nonzero(img_m.data(), img_m.width(), img_m.height());
+
+		BitMask mf;
+		if (HasFixed && (FS > 0))
+			mf.assign_range(img_f.data(), img_f.width(), img_f.height(), 0, 253);
+
+		// land and water are processed concurrently
+		SkeletonBranch bl, bw;
+		bl.Land = true;
+		bw.Land = false;
+		bl.mm = bw.mm = &mm;
+		bl.mf = bw.mf = (HasFixed && (FS > 0)) ? &mf : NULL;
+		bl.Erosion = bw.Erosion = (unsigned int)(2*Radius[0]);
+		bl.img_s = &img_sl;
+		bw.img_s = &img_sw;
+		bl.codes = &img_cl;
+		bw.codes = &img_cw;
+		bl.img_d = bw.img_d = Debug ? &img_d : NULL;
+		bl.debug = bw.debug = Debug ? scratch.debug : NULL;
+
+		SkeletonStage skel_l(bl), skel_w(bw);
+		JunctionStage junc_l(bl), junc_w(bw);
+
+		StageGraph graph;
+		graph.add(&skel_l, 0, RES_SL);
+		graph.add(&skel_w, 0, RES_SW);
+		graph.add(&junc_l, 0, RES_SL | RES_CL | RES_D);
+		graph.add(&junc_w, 0, RES_SW | RES_CW | RES_D);
+
+		std::fprintf(stderr,"Skeletonizing...\n");
+		graph.run();
+
+		std::fprintf(stderr,"  land: %d fixed, %d variable.\n", bl.cnt_fixed, bl.cnt_variable);
+		std::fprintf(stderr,"  water: %d fixed, %d variable.\n", bw.cnt_fixed, bw.cnt_variable);
+	}
+
+	Prof.begin("smoothing", npx);
+	std::fprintf(stderr,"Doing basic smoothing...\n");
+
+	img_b = img_m;
+	blur_mask(img_b.data(), img_b.width(), img_b.height(), Radius[0]);
+
+	if (HasFixed && (FS > 0))
+	{
+		cimg_forXY(img_f,px,py)
+		{
+			if (img_f(px,py) < 254)
+			{
+				img_b(px,py) = 0;
+			}
+		}
+	}
+
+	CImg<unsigned char> img_sl2 = img_sl;
+	CImg<unsigned char> img_sw2 = img_sw;
+	CImg<unsigned char> img_swx = img_sw;
+	CImg<unsigned char> img_slx = img_sl;
+
+	Prof.begin("shorten", npx);
+	std::fprintf(stderr,"Shortening primary skeletons...\n");
+
+	// number of end point removal iterations for the different skeletons
+	int NX = 0;
+	int N1 = 0;
+	int N05 = 0;
+	for (int j=0; j < Radius[1]*1.6; j++)
+	{
+		NX++;
+		if (j < Radius[1]*1.2) N1++;
+		if (j < Radius[1]*0.5) N05++;
+	}
+
+	int NW = 0;
+	if (Radius[2] != 0)
+	{
+		NW = 1;
+		while (!(NW > Radius[2]*20)) NW++;
+	}
+
+	{
+		CImg<unsigned short> img_pl, img_pw;
+		PruneStage prune_l(img_sl, img_cl, NX, img_pl);
+		PruneStage prune_w(img_sw, img_cw, std::max(N1, NW), img_pw);
+
+		StageGraph graph;
+		graph.add(&prune_l, RES_SL, RES_CL | RES_PL);
+		graph.add(&prune_w, RES_SW, RES_CW | RES_PW);
+		graph.run();
+
+		scratch.u8.give(img_cl);
+		scratch.u8.give(img_cw);
+
+		cimg_forXY(img_sl,px,py)
+		{
+			if (Debug)
+			{
+				if ((img_pl(px,py) > 0) && (img_pl(px,py) <= N1))
+					img_d(px,py) = 200;
+				if ((img_pw(px,py) > 0) && (img_pw(px,py) <= N1))
+					img_d(px,py) = 200;
+				if ((img_pw(px,py) > 0) && (img_pw(px,py) <= N05))
+					img_d(px,py) = 255;
+			}
+
+			if (img_pl(px,py) <= NX) img_slx(px,py) = 0;
+			if (img_pl(px,py) <= N1) img_sl(px,py) = 0;
+			if (img_pw(px,py) <= N1) img_sw(px,py) = 0;
+			if (img_pw(px,py) <= N05) img_sw2(px,py) = 0;
+			if (img_pw(px,py) <= NW) img_swx(px,py) = 0;
+		}
+	}
+
+	if (Radius[2] == 0)
+		img_swx.fill(0);
+	else
+		std::fprintf(stderr,"Generating water base skeleton (%d iterations)...\n", NW);
+
+	if (Debug)
+	{
+		scratch.debug->save(img_sl, "debug-skel2-l.pgm");
+		scratch.debug->save(img_sl2, "debug-skel2-l2.pgm");
+		scratch.debug->save(img_slx, "debug-skel2-lx.pgm");
+		scratch.debug->save(img_sw, "debug-skel2-w.pgm");
+		scratch.debug->save(img_sw2, "debug-skel2-w2.pgm");
+		scratch.debug->save(img_swx, "debug-skel2-wx.pgm");
+	}
+
+	Prof.begin("dilate", npx);
+	std::fprintf(stderr,"Dilating skeleton...\n");
+
+	float rsum = 0.0;
+
+	while (rsum < Radius[1]+0.01)
+	{
+		cimg_forXY(img_il,px,py)
+		{
+			const int c = island_c[img_il(px,py)];
+			if (c > 1)
+				if (c < rsum*rsum*4.0)
+				if (c < IThr[2])
+				{
+					img_sl(px,py) = 255;
+					img_sl2(px,py) = 255;
+				}
+		}
+
+		float r = std::min(float(1.0),Radius[1]-rsum);
+		if (r < 0.01) break;
+		std::fprintf(stderr,"  step 1 (%.2f)...\n", r);
+
+		unsigned char *layers[SKEL_LAYERS] = { img_sl.data(), img_sw.data(), img_sl2.data(), img_sw2.data(), img_swx.data(), img_slx.data() };
+		DilationRule rule;
+		rule.Secondary = (rsum < Radius[1]*0.5);
+		rule.WaterBase = (rsum < Radius[2]);
+		rule.LandBase = (rsum < Radius[3]);
+		const bool active[SKEL_LAYERS] = { true, true, rule.Secondary, rule.Secondary, rule.WaterBase, rule.LandBase };
+
+		blur_layers(layers, active, SKEL_LAYERS, img_sl.width(), img_sl.height(), r, rule);
+
+		rsum += r;
+	}
+
+	if (Debug)
+	{
+		scratch.debug->save(img_sl, "debug-skel3-l.pgm");
+		scratch.debug->save(img_sl2, "debug-skel3-l2.pgm");
+		scratch.debug->save(img_slx, "debug-skel3-lx.pgm");
+		scratch.debug->save(img_sw, "debug-skel3-w.pgm");
+		scratch.debug->save(img_sw2, "debug-skel3-w2.pgm");
+		scratch.debug->save(img_swx, "debug-skel3-wx.pgm");
+	}
+
+	// the skeleton layers are binary from here on
+	BitMask ml, mlx, mw, mw2, mwx;
+	ml.assign_nonzero(img_sl.data(), img_sl.width(), img_sl.height());
+	{
+		BitMask ml2;
+		ml2.assign_nonzero(img_sl2.data(), img_sl2.width(), img_sl2.height());
+		ml |= ml2;
+	}
+	mlx.assign_nonzero(img_slx.data(), img_slx.width(), img_slx.height());
+	mw.assign_nonzero(img_sw.data(), img_sw.width(), img_sw.height());
+	mw2.assign_nonzero(img_sw2.data(), img_sw2.width(), img_sw2.height());
+	mwx.assign_nonzero(img_swx.data(), img_swx.width(), img_swx.height());
+	img_sl.assign();
+	img_sl2.assign();
+	img_slx.assign();
+	img_sw.assign();
+	img_sw2.assign();
+	img_swx.assign();
+
+	// no water skeleton at all
+	BitMask mdry = mw;
+	mdry |= mw2;
+	mdry |= mwx;
+	mdry.invert();
+
+	{
+		// below the smoothing threshold
+		BitMask mlow(img_m.width(), img_m.height());
+
+		cimg_forXY(img_m,px,py)
+		{
+			// largest island size class in the 3x3 neighborhood
+			int c = 0;
+			for (int yn = std::max(py-1, 0); yn <= std::min(py+1, img_m.height()-1); yn++)
+				for (int xn = std::max(px-1, 0); xn <= std::min(px+1, img_m.width()-1); xn++)
+					c = std::max(c, island_c[img_il(xn,yn)]);
+
+			if (img_b(px,py) < (((c<IThr[3])&&(c>1))?SLevel*255:Level*255))
+				mlow.set(px,py);
+		}
+
+		// land unless below threshold without land skeleton, otherwise where
+		// there is a land base skeleton or no water skeleton
+		mlow.and_not(ml);
+		BitMask mres = mdry;
+		mres |= mlx;
+		mres.and_not(mlow);
+		mres.to_bytes(img_m.data(), 255);
+	}
+
+	if (Debug)
+		scratch.debug->save(img_m, "debug-m.pgm");
+
+	Prof.begin("postprocess", npx);
+	std::fprintf(stderr,"Postprocessing Islands...\n");
+
+	cimg_forXY(img_il,px,py)
+	{
+		const int c = island_c[img_il(px,py)];
+		img_b(px,py) = 0;
+		if (mdry.get(px,py))
+		if (c > 1)
+		{
+			if (c < IThr[2])
+			{
+				img_b(px,py) = 255;
+				if (Debug) img_d(px,py) = 180;
+			}
+			else if (c < IThr[2]*3)
+			{
+				img_b(px,py) = 64;
+				if (Debug) img_d(px,py) = 160;
+			}
+			else if (c < IThr[2]*8)
+			{
+				img_b(px,py) = 32;
+				if (Debug) img_d(px,py) = 140;
+			}
+		}
+	}
+
+	blur_mask(img_b.data(), img_b.width(), img_b.height(), Radius[4]);
+
+	cimg_forXY(img_b,px,py)
+	{
+		if (!mw.get(px,py))
+		{
+			if (!mw2.get(px,py))
+			{
+				if (!mwx.get(px,py))
+				{
+					if (img_b(px,py) >= ILevel*255)
+						img_m(px,py) = 255;
+				}
+				else
+				{
+					if (img_b(px,py) >= ILevel*2*255)
+						img_m(px,py) = 255;
+				}
+			}
+			else
+			{
+				if (img_b(px,py) >= ILevel*3*255)
+					img_m(px,py) = 255;
+			}
+		}
+	}
+
+	if (HasFixed && (FS > 0))
+	{
+		cimg_forXY(img_f,px,py)
+		{
+			if (img_f(px,py) < 255)
+			{
+				if (img_f(px,py) == 254)
+					img_m(px,py) = 255;
+				else
+					img_m(px,py) = 0;
+			}
+		}
+	}
+
+	if (Debug)
+		scratch.debug->save(img_d, "debug-d.pgm");
+
+	Prof.end();
+}
+
+// distance in pixels up to which the generalization result at a point can
+// depend on the input data, used as overlap between tiles.  Islands need to
+// be contained completely to be classified correctly so their size thresholds
+// usually dominate.
+int Generalizer::influence_radius(const Parameters &P, const bool HasFixed)
+{
+	const float *Radius = P.Radius;
+
+	// skeleton erosion, shortening and dilation
+	float r = 2*Radius[0] + std::max(Radius[1]*1.6f, Radius[2]*20.0f) + 3.0f*Radius[1];
+	// smoothing
+	r = std::max(r, 3.0f*std::max(Radius[0], Radius[4]));
+	// collapsing
+	r = std::max(r, Radius[6]*9.0f);
+	// islands
+	r = std::max(r, float(std::max(P.IThr[3], P.IThr[2]*8)) + Radius[1]);
+
+	if (HasFixed)
+		r += P.FR + P.FConRad + 2;
+
+	return int(std::ceil(r)) + 2;
+}
+
+// finished core of a tile waiting to be written back
+struct TileCore
+{
+	int x0, y0;
+	int last;
+	CImg<unsigned char> img;
+};
+
+// generalizes img_m in tiles of TileSize pixels with Halo pixels overlap so
+// working memory is bounded by the tile size rather than the image size,
+// finished tiles are passed to Sink if given.  Tiles without active blocks
+// of occ (if given) within the overlap are set to the known values.  The
+// result is written to img_m in place, the core of a tile is kept until
+// the last tile reading it in its overlap is done.
+static void generalize_tiled(CImg<unsigned char> &img_m, const CImg<unsigned char> &img_f, const CImg<unsigned char> &img_co, const Parameters &P, const int TileSize, const int Halo, const Occupancy *occ, Scratch &scratch, Profile &Prof, TileSink *Sink)
+{
+	const int ntx = (img_m.width()+TileSize-1)/TileSize;
+	const int nty = (img_m.height()+TileSize-1)/TileSize;
+
+	// tiles up to k tiles away read the core of a tile
+	const int k = (Halo+TileSize-1)/TileSize;
+	std::deque<TileCore> pending;
+
+	Parameters PT = P;
+	PT.Debug = false;
+
+	for (int ty = 0; ty < nty; ty++)
+		for (int tx = 0; tx < ntx; tx++)
+		{
+			// core area of the tile
+			const int x0 = tx*TileSize;
+			const int y0 = ty*TileSize;
+			const int x1 = std::min(x0+TileSize, img_m.width())-1;
+			const int y1 = std::min(y0+TileSize, img_m.height())-1;
+
+			// core plus halo
+			const int wx0 = std::max(0, x0-Halo);
+			const int wy0 = std::max(0, y0-Halo);
+			const int wx1 = std::min(img_m.width()-1, x1+Halo);
+			const int wy1 = std::min(img_m.height()-1, y1+Halo);
+
+			CImg<unsigned char> core;
+
+			if ((occ != NULL) && !occ->any_active(wx0, wy0, wx1, wy1))
+			{
+				std::fprintf(stderr,"Skipping tile %d/%d (%d,%d)-(%d,%d)...\n", ty*ntx+tx+1, ntx*nty, x0, y0, x1, y1);
+				Prof.begin("narrow_band", (size_t)(x1-x0+1)*(y1-y0+1));
+				core.assign(x1-x0+1, y1-y0+1, 1, 1, occ->known(x0/occ->size(), y0/occ->size()));
+			}
+			else
+			{
+				std::fprintf(stderr,"Processing tile %d/%d (%d,%d)-(%d,%d)...\n", ty*ntx+tx+1, ntx*nty, x0, y0, x1, y1);
+
+				Prof.begin("tiling", (size_t)(wx1-wx0+1)*(wy1-wy0+1));
+				CImg<unsigned char> tile_m = img_m.get_crop(wx0, wy0, wx1, wy1);
+				CImg<unsigned char> tile_f;
+				CImg<unsigned char> tile_co;
+
+				if (!img_f.is_empty())
+					tile_f = img_f.get_crop(wx0, wy0, wx1, wy1);
+				if (!img_co.is_empty())
+					tile_co = img_co.get_crop(wx0, wy0, wx1, wy1);
+
+				generalize(tile_m, tile_f, tile_co, PT, scratch, Prof);
+
+				Prof.begin("tiling", 0);
+				core = tile_m.get_crop(x0-wx0, y0-wy0, x1-wx0, y1-wy0);
+			}
+			if (Sink != NULL)
+			{
+				Prof.end();
+				Sink->tile(core.data(), core.width(), x0, y0, core.width(), core.height());
+			}
+
+			pending.push_back(TileCore());
+			pending.back().x0 = x0;
+			pending.back().y0 = y0;
+			pending.back().last = std::min(ty+k, nty-1)*ntx + std::min(tx+k, ntx-1);
+			pending.back().img.swap(core);
+
+			Prof.begin("tiling", 0);
+			while (!pending.empty() && (pending.front().last <= ty*ntx+tx))
+			{
+				img_m.draw_image(pending.front().x0, pending.front().y0, pending.front().img);
+				pending.pop_front();
+			}
+			Prof.end();
+		}
+}
+
+/*
+ * Windows around the connected groups of blocks (size bs) marked in blocks
+ * reaching Halo pixels further.  img_g receives the group of every block,
+ * windows[g] the window of group g (windows[0] is unused).  Returns the
+ * number of pixels of all windows together.
+ */
+
+static size_t block_windows(const std::vector<unsigned char> &blocks, const int nbx, const int nby, const int bs,
+                            const int xsize, const int ysize, const int Halo,
+                            CImg<unsigned int> &img_g, std::vector<Rect> &windows)
+{
+	CImg<unsigned char> img_b(nbx, nby, 1, 1);
+	std::copy(blocks.begin(), blocks.end(), img_b.data());
+	std::vector<ComponentStats> groups;
+	const size_t ng = img_b.label4(1, img_g, groups);
+
+	size_t npw = 0;
+	windows.resize(ng+1);
+	for (size_t g = 1; g <= ng; g++)
+	{
+		Rect &w = windows[g];
+		w.x0 = std::max(0, groups[g].x0*bs-Halo);
+		w.y0 = std::max(0, groups[g].y0*bs-Halo);
+		w.x1 = std::min(xsize, (groups[g].x1+1)*bs+Halo)-1;
+		w.y1 = std::min(ysize, (groups[g].y1+1)*bs+Halo)-1;
+		npw += (size_t)(w.x1-w.x0+1)*(w.y1-w.y0+1);
+	}
+	return npw;
+}
+
+// generalizes the windows of block_windows() one after the other and
+// writes the blocks of each group to img_o
+static void generalize_windows(const CImg<unsigned char> &img_m, const CImg<unsigned char> &img_f, const CImg<unsigned char> &img_co, const Parameters &P,
+                               const int bs, const CImg<unsigned int> &img_g, const std::vector<Rect> &windows,
+                               CImg<unsigned char> &img_o, Scratch &scratch, Profile &Prof, const char *stage)
+{
+	const int xsize = img_m.width();
+	const int ysize = img_m.height();
+
+	Parameters PT = P;
+	PT.Debug = false;
+
+	for (size_t g = 1; g < windows.size(); g++)
+	{
+		const Rect &w = windows[g];
+		std::fprintf(stderr,"Processing window %ld/%ld (%d,%d)-(%d,%d)...\n", (long)g, (long)windows.size()-1, w.x0, w.y0, w.x1, w.y1);
+
+		Prof.begin(stage, (size_t)(w.x1-w.x0+1)*(w.y1-w.y0+1));
+		CImg<unsigned char> tile_m = img_m.get_crop(w.x0, w.y0, w.x1, w.y1);
+		CImg<unsigned char> tile_f;
+		CImg<unsigned char> tile_co;
+
+		if (!img_f.is_empty())
+			tile_f = img_f.get_crop(w.x0, w.y0, w.x1, w.y1);
+		if (!img_co.is_empty())
+			tile_co = img_co.get_crop(w.x0, w.y0, w.x1, w.y1);
+
+		generalize(tile_m, tile_f, tile_co, PT, scratch, Prof);
+
+		// only the blocks of the group are taken from the window
+		Prof.begin(stage, 0);
+		for (int by = w.y0/bs; by <= w.y1/bs; by++)
+			for (int bx = w.x0/bs; bx <= w.x1/bs; bx++)
+				if (img_g(bx,by) == g)
+				{
+					const int x0 = bx*bs - w.x0;
+					const int y0 = by*bs - w.y0;
+					const int x1 = std::min((bx+1)*bs, xsize)-1 - w.x0;
+					const int y1 = std::min((by+1)*bs, ysize)-1 - w.y0;
+					img_o.draw_image(bx*bs, by*bs, tile_m.get_crop(x0, y0, x1, y1));
+				}
+	}
+
+	Prof.end();
+}
+
+// generalizes only the band of blocks within Halo of the active blocks of
+// occ, see block_windows(), the other pixels are set to their known values.
+// Returns false without processing if the band covers the whole image or
+// nothing or the windows together are larger than the image.
+static bool generalize_band(CImg<unsigned char> &img_m, const CImg<unsigned char> &img_f, const CImg<unsigned char> &img_co, const Parameters &P, const Occupancy &occ, const int Halo, Scratch &scratch, Profile &Prof)
+{
+	const int bs = occ.size();
+	const int nbx = occ.blocks_x();
+	const int nby = occ.blocks_y();
+
+	std::vector<unsigned char> band;
+	occ.band(Halo, band);
+	const size_t nband = std::count(band.begin(), band.end(), 1);
+	if ((nband == 0) || (nband == band.size()))
+		return false;
+
+	CImg<unsigned int> img_g;
+	std::vector<Rect> windows;
+	if (block_windows(band, nbx, nby, bs, img_m.width(), img_m.height(), Halo, img_g, windows) >= img_m.size())
+		return false;
+
+	Prof.begin("narrow_band", img_m.size());
+	std::fprintf(stderr,"Narrow band processing of %ld/%ld blocks in %ld windows...\n", (long)nband, (long)band.size(), (long)windows.size()-1);
+
+	CImg<unsigned char> img_o(img_m.width(), img_m.height(), 1, 1);
+
+	cimg_forXY(img_o,px,py)
+	{
+		const int bx = px/bs;
+		const int by = py/bs;
+		if (!band[(size_t)by*nbx + bx])
+			img_o(px,py) = occ.known(bx, by);
+	}
+
+	generalize_windows(img_m, img_f, img_co, P, bs, img_g, windows, img_o, scratch, Prof, "narrow_band");
+
+	// copy, img_m can share the memory of the caller
+	img_m = img_o;
+	return true;
+}
+
+// --- library interface ---
+
+// working images kept by a Generalizer between calls, batch holds the
+// scratch images of the concurrently processed sets of run_batch()
+struct Generalizer::Buffers
+{
+	Scratch scratch;
+	CImg<unsigned char> img_f;
+	CImg<unsigned char> img_co;
+	std::vector<Scratch> batch;
+	DistanceCache distances;
+};
+
+// rough peak memory of generalize() per pixel in bytes, measured on large
+// images with fixed mask
+const static double BATCH_BYTES_PER_PIXEL = 32.0;
+
+// distance fields kept for sharing between the sets of run_batch(), every
+// one needs a bit over 4 bytes per pixel
+const static int BATCH_DISTANCE_FIELDS = 4;
+
+// physical memory currently available in kB
+static long available_memory_kb()
+{
+	const long pages = sysconf(_SC_AVPHYS_PAGES);
+	const long page_size = sysconf(_SC_PAGESIZE);
+	if ((pages <= 0) || (page_size <= 0))
+		return 0;
+	return (long)((double)pages*page_size/1024.0);
+}
+
+// the parameters preprocess() depends on are equal
+static bool same_preprocessing(const Parameters &P1, const Parameters &P2)
+{
+	return (P1.FS == P2.FS) && (P1.FR == P2.FR) && (P1.NGConnected == P2.NGConnected) &&
+	       (P1.FConRad == P2.FConRad) && (P1.XCon == P2.XCon);
+}
+
+Generalizer::Generalizer(): buffers(new Buffers())
+{
+}
+
+Generalizer::~Generalizer()
+{
+	delete buffers;
+}
+
+void Generalizer::release()
+{
+	delete buffers;
+	buffers = new Buffers();
+}
+
+bool Generalizer::run(unsigned char *mask, const int xsize, const int ysize,
+                      const unsigned char *fixed, const unsigned char *collapse,
+                      const Parameters &P, const int TileSize, const int Halo,
+                      Profile *Prof, TileSink *Sink)
+{
+	if ((mask == NULL) || (xsize <= 0) || (ysize <= 0))
+	{
+		std::fprintf(stderr,"  invalid mask image.\n");
+		return false;
+	}
+
+	Profile disabled;
+	Profile &Pr = (Prof != NULL) ? *Prof : disabled;
+
+	// the mask is processed in place, the fixed and collapse masks are
+	// modified by generalize() so they are copied to kept buffers, except
+	// in tiled processing which only reads them
+	CImg<unsigned char> img_m(mask, xsize, ysize, 1, 1, true);
+	CImg<unsigned char> &img_f = buffers->img_f;
+	CImg<unsigned char> &img_co = buffers->img_co;
+	CImg<unsigned char> shared_f;
+	CImg<unsigned char> shared_co;
+
+	if (fixed == NULL)
+		img_f.assign();
+	else if (TileSize > 0)
+		shared_f.assign(fixed, xsize, ysize, 1, 1, true);
+	else
+		img_f.assign(fixed, xsize, ysize, 1, 1, false);
+
+	if (collapse == NULL)
+		img_co.assign();
+	else if (TileSize > 0)
+		shared_co.assign(collapse, xsize, ysize, 1, 1, true);
+	else
+		img_co.assign(collapse, xsize, ysize, 1, 1, false);
+
+	Occupancy occ;
+	if (P.BlockSize > 0)
+	{
+		Pr.begin("narrow_band", img_m.size());
+		occ.assign(mask, fixed, xsize, ysize, P.BlockSize);
+		Pr.end();
+	}
+
+	if (TileSize > 0)
+	{
+		const int H = (Halo >= 0) ? Halo : influence_radius(P, fixed != NULL);
+		std::fprintf(stderr,"Tiled processing with %d pixel tiles and %d pixel overlap...\n", TileSize, H);
+		if (P.Debug)
+			std::fprintf(stderr,"  debug output is not available in tiled mode.\n");
+
+		generalize_tiled(img_m, shared_f, shared_co, P, TileSize, H, (P.BlockSize > 0) ? &occ : NULL, buffers->scratch, Pr, Sink);
+	}
+	else if (P.Debug)
+	{
+		// the debug images are written while the processing continues
+		DebugWriter debug(P.DebugImages, P.DebugWindow);
+		buffers->scratch.debug = &debug;
+		generalize(img_m, img_f, img_co, P, buffers->scratch, Pr);
+		buffers->scratch.debug = NULL;
+		debug.finish();
+	}
+	else if ((P.BlockSize <= 0) ||
+	         !generalize_band(img_m, img_f, img_co, P, occ, influence_radius(P, fixed != NULL), buffers->scratch, Pr))
+		generalize(img_m, img_f, img_co, P, buffers->scratch, Pr);
+
+	return true;
+}
+
+bool Generalizer::update(unsigned char *result, const unsigned char *mask, const int xsize, const int ysize,
+                         const unsigned char *fixed, const unsigned char *collapse,
+                         const Parameters &P, const unsigned char *previous,
+                         const Rect *dirty, const int n, Profile *Prof)
+{
+	if ((result == NULL) || (mask == NULL) || (xsize <= 0) || (ysize <= 0) || ((n > 0) && (dirty == NULL)))
+	{
+		std::fprintf(stderr,"  invalid mask image.\n");
+		return false;
+	}
+
+	Profile disabled;
+	Profile &Pr = (Prof != NULL) ? *Prof : disabled;
+
+	Pr.begin("incremental", (size_t)xsize*ysize);
+	std::fprintf(stderr,"Locating changes...\n");
+
+	const int bs = (P.BlockSize > 0) ? P.BlockSize : 64;
+	const int nbx = (xsize+bs-1)/bs;
+	const int nby = (ysize+bs-1)/bs;
+
+	// changed blocks
+	std::vector<unsigned char> changed((size_t)nbx*nby, 0);
+
+	if (previous != NULL)
+	{
+#pragma omp parallel for schedule(dynamic)
+		for (int by = 0; by < nby; by++)
+			for (int y = by*bs; y < std::min((by+1)*bs, ysize); y++)
+			{
+				const size_t r = (size_t)y*xsize;
+				for (int bx = 0; bx < nbx; bx++)
+				{
+					const int x0 = bx*bs;
+					const int w = std::min(bs, xsize-x0);
+					if (std::memcmp(mask + r + x0, previous + r + x0, w) != 0)
+						changed[(size_t)by*nbx + bx] = 1;
+				}
+			}
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		const int x0 = std::max(0, std::min(dirty[i].x0, dirty[i].x1));
+		const int y0 = std::max(0, std::min(dirty[i].y0, dirty[i].y1));
+		const int x1 = std::min(xsize-1, std::max(dirty[i].x0, dirty[i].x1));
+		const int y1 = std::min(ysize-1, std::max(dirty[i].y0, dirty[i].y1));
+		for (int by = y0/bs; by <= y1/bs; by++)
+			for (int bx = x0/bs; bx <= x1/bs; bx++)
+				changed[(size_t)by*nbx + bx] = 1;
+	}
+
+	// blocks the changes can have an effect on
+	const int H = influence_radius(P, fixed != NULL);
+	const int nd = (H+bs-1)/bs;
+	std::vector<unsigned char> affected(changed.size(), 0);
+	for (int by = 0; by < nby; by++)
+		for (int bx = 0; bx < nbx; bx++)
+			if (changed[(size_t)by*nbx + bx])
+				for (int yn = std::max(by-nd, 0); yn <= std::min(by+nd, nby-1); yn++)
+					std::fill(affected.begin() + (size_t)yn*nbx + std::max(bx-nd, 0),
+					          affected.begin() + (size_t)yn*nbx + std::min(bx+nd, nbx-1) + 1, 1);
+
+	const size_t nc = std::count(changed.begin(), changed.end(), 1);
+	const size_t na = std::count(affected.begin(), affected.end(), 1);
+	std::fprintf(stderr,"  %ld/%ld blocks changed, %ld affected.\n", (long)nc, (long)changed.size(), (long)na);
+
+	if (na > 0)
+	{
+		const CImg<unsigned char> img_m(mask, xsize, ysize, 1, 1, true);
+		CImg<unsigned char> img_f;
+		CImg<unsigned char> img_co;
+		if (fixed != NULL)
+			img_f.assign(fixed, xsize, ysize, 1, 1, true);
+		if (collapse != NULL)
+			img_co.assign(collapse, xsize, ysize, 1, 1, true);
+		CImg<unsigned char> img_o(result, xsize, ysize, 1, 1, true);
+
+		CImg<unsigned int> img_g;
+		std::vector<Rect> windows;
+		block_windows(affected, nbx, nby, bs, xsize, ysize, H, img_g, windows);
+		generalize_windows(img_m, img_f, img_co, P, bs, img_g, windows, img_o, buffers->scratch, Pr, "incremental");
+	}
+
+	Pr.end();
+	return true;
+}
+
+bool Generalizer::run_batch(const unsigned char *mask, const int xsize, const int ysize,
+                            const unsigned char *fixed, const unsigned char *collapse,
+                            const Parameters *P, const int n, unsigned char **results,
+                            const int MemoryLimit, Profile *Prof)
+{
+	if ((mask == NULL) || (xsize <= 0) || (ysize <= 0))
+	{
+		std::fprintf(stderr,"  invalid mask image.\n");
+		return false;
+	}
+
+	Profile disabled;
+	Profile &Pr = (Prof != NULL) ? *Prof : disabled;
+
+	// preprocessing once for every distinct combination of the parameters
+	// it depends on
+	std::vector<Preprocessed> pre;
+	pre.reserve(n);
+	std::vector<int> pre_of(n);
+	for (int i = 0; i < n; i++)
+	{
+		pre_of[i] = -1;
+		for (int j = 0; j < i; j++)
+			if (same_preprocessing(P[i], P[j]))
+			{
+				pre_of[i] = pre_of[j];
+				break;
+			}
+
+		if (pre_of[i] < 0)
+		{
+			std::fprintf(stderr,"Preprocessing for parameter set %d...\n", i+1);
+			Parameters PT = P[i];
+			PT.Debug = false;
+			pre.push_back(Preprocessed());
+			Preprocessed &p = pre.back();
+			p.img_m.assign(mask, xsize, ysize, 1, 1, false);
+			if (fixed != NULL)
+				p.img_f.assign(fixed, xsize, ysize, 1, 1, false);
+			p.Trivial = !preprocess(p.img_m, p.img_f, p.img_b, PT, buffers->scratch, Pr);
+			pre_of[i] = pre.size()-1;
+		}
+	}
+
+	// distance fields can only be shared by sets with the same preprocessing
+	DistanceCache &cache = buffers->distances;
+	cache.reset((n > (int)pre.size()) ? BATCH_DISTANCE_FIELDS : 0);
+
+	// sets processed concurrently, limited by the number of threads and the
+	// memory available besides the preprocessed images and distance fields
+	int nconc = 1;
+#ifdef _OPENMP
+	nconc = std::max(1, std::min(n, omp_get_max_threads()));
+#endif
+	const double npx = (double)xsize*ysize;
+	double avail = (MemoryLimit > 0) ? MemoryLimit*1048576.0 : available_memory_kb()*1024.0;
+	avail -= pre.size()*3*npx;
+	if (cache.is_enabled())
+		avail -= BATCH_DISTANCE_FIELDS*4.125*npx;
+	nconc = std::max(1, std::min(nconc, (int)(avail/(npx*BATCH_BYTES_PER_PIXEL))));
+
+	if (nconc > 1)
+		std::fprintf(stderr,"Processing %d parameter sets, %d concurrently...\n", n, nconc);
+
+	std::vector<Scratch> &scratch = buffers->batch;
+	if ((int)scratch.size() < nconc)
+		scratch.resize(nconc);
+	for (size_t i = 0; i < scratch.size(); i++)
+		scratch[i].cache = &cache;
+
+	// the stages of concurrent sets can not be told apart
+	if (nconc > 1)
+		Pr.begin("batch", (size_t)npx*n);
+
+#pragma omp parallel for num_threads(nconc) schedule(dynamic,1) if (nconc > 1)
+	for (int i = 0; i < n; i++)
+	{
+		int t = 0;
+#ifdef _OPENMP
+		t = omp_get_thread_num();
+#endif
+		Parameters PT = P[i];
+		PT.Debug = false;
+
+		CImg<unsigned char> img_m(results[i], xsize, ysize, 1, 1, true);
+		CImg<unsigned char> img_f;
+		CImg<unsigned char> img_co;
+		if (collapse != NULL)
+			img_co.assign(collapse, xsize, ysize, 1, 1, false);
+
+		Profile none;
+		generalize(img_m, img_f, img_co, PT, scratch[t], (nconc > 1) ? none : Pr, &pre[pre_of[i]]);
+	}
+
+	Pr.end();
+
+	if (cache.reused() > 0)
+		std::fprintf(stderr,"  %d distance fields shared between parameter sets.\n", cache.reused());
+	cache.reset(0);
+
+	return true;
+}
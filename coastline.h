@@ -0,0 +1,119 @@
+// coastline_gen library interface
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef COASTLINE_H
+#define COASTLINE_H
+
+#include "profile.h"
+
+/*
+ * Generalization of land water masks held in memory.  All images are byte
+ * valued, xsize*ysize pixels in rows without padding.  Land pixels are > 0,
+ * water 0 and 255 marks connection pixels (see README.md).
+ *
+ *   Parameters P;                  // defaults of the coastline_gen program
+ *   Generalizer G;
+ *   G.run(mask, xsize, ysize, NULL, NULL, P);
+ *
+ * A Generalizer keeps its working images between calls, so repeated calls
+ * with images of the same size do not allocate memory again.  Separate
+ * Generalizer objects can be used concurrently.
+ */
+
+// rectangle of the pixels x0,y0 to x1,y1 inclusive
+struct Rect
+{
+	int x0, y0, x1, y1;
+};
+
+// generalization parameters, see README.md for their meaning.  With Debug
+// the images of the intermediate steps matching DebugImages (NULL: all) are
+// written, cropped to DebugWindow unless it is empty (x1 < x0).
+struct Parameters
+{
+	float Level;
+	float SLevel;
+	float ILevel;
+	int FS;
+	int FR;
+	bool NGConnected;
+	int FConRad;
+	bool XCon;
+	float Radius[8];
+	int IThr[4];
+	int BlockSize;
+	bool Debug;
+	const char *DebugImages;
+	Rect DebugWindow;
+
+	Parameters();
+};
+
+// receives the results of tiled processing tile by tile, data points to the
+// w*h generalized core pixels of the tile at x0,y0 in rows of stride bytes
+class TileSink
+{
+public:
+	virtual ~TileSink() {}
+	virtual void tile(const unsigned char *data, const long stride,
+	                  const int x0, const int y0, const int w, const int h) = 0;
+};
+
+class Generalizer
+{
+public:
+	Generalizer();
+	~Generalizer();
+
+	// generalizes mask in place.  fixed (fixed mask) and collapse (collapse
+	// mask) are optional and can be NULL, they are not modified.  With
+	// TileSize > 0 the image is processed in tiles with Halo pixels overlap
+	// (Halo < 0: influence_radius()), each finished tile is passed to Sink
+	// if given.  With P.BlockSize > 0 (default 0) only blocks near the
+	// coastline are generalized, see README.md.  The stages are recorded
+	// in Prof if given.  Returns false if the arguments are invalid.
+	bool run(unsigned char *mask, const int xsize, const int ysize,
+	         const unsigned char *fixed, const unsigned char *collapse,
+	         const Parameters &P, const int TileSize = 0, const int Halo = -1,
+	         Profile *Prof = NULL, TileSink *Sink = NULL);
+
+	// generalizes mask with the n parameter sets P, the result of set i is
+	// written to results[i] (xsize*ysize bytes).  mask, fixed and collapse
+	// are not modified.  The fixed mask preprocessing and land measurement
+	// run once for all sets with the same FS, FR, NGConnected, FConRad and
+	// XCon.  The sets are processed concurrently as far as the threads and
+	// MemoryLimit (in MB, 0: the available memory) allow.  Debug output and
+	// narrow band processing are not available.
+	bool run_batch(const unsigned char *mask, const int xsize, const int ysize,
+	               const unsigned char *fixed, const unsigned char *collapse,
+	               const Parameters *P, const int n, unsigned char **results,
+	               const int MemoryLimit = 0, Profile *Prof = NULL);
+
+	// updates result, the generalization of an earlier version of mask with
+	// the same parameters, fixed and collapse mask, to the current mask.
+	// The mask changed in the n rectangles of dirty and, if previous (the
+	// earlier mask) is given, where it differs from previous.  Only the
+	// area within influence_radius() of the changes is generalized again.
+	// Returns false if the arguments are invalid.
+	bool update(unsigned char *result, const unsigned char *mask, const int xsize, const int ysize,
+	            const unsigned char *fixed, const unsigned char *collapse,
+	            const Parameters &P, const unsigned char *previous,
+	            const Rect *dirty, const int n, Profile *Prof = NULL);
+
+	// frees the working images kept from earlier calls
+	void release();
+
+	// distance in pixels up to which the result at a point can depend on
+	// the input data
+	static int influence_radius(const Parameters &P, const bool HasFixed);
+
+private:
+	struct Buffers;
+	Buffers *buffers;
+
+	Generalizer(const Generalizer &);
+	Generalizer &operator=(const Generalizer &);
+};
+
+#endif
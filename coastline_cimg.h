@@ -0,0 +1,41 @@
+// CImg configuration shared by all parts of coastline_gen
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef COASTLINE_CIMG_H
+#define COASTLINE_CIMG_H
+
+/*
+ * The plugins extend the CImg class so every translation unit using CImg
+ * needs to include it with the same settings, always include CImg.h
+ * through this file.
+ */
+
+#include <cstdlib>
+#include <algorithm>
+#include <climits>
+#include <stack>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define cimg_plugin "CImg_skeleton.h"
+#define cimg_plugin1 "CImg_label.h"
+#define cimg_plugin2 "CImg_distance.h"
+#define cimg_plugin3 "CImg_morph.h"
+#define cimg_plugin4 "CImg_contour.h"
+
+#define cimg_use_tiff 1
+#define cimg_use_png 1
+#define cimg_display 0
+
+#include "skeleton.h"
+#include "label.h"
+#include "contour.h"
+#include "CImg.h"
+
+using namespace cimg_library;
+
+#endif
@@ -31,20 +31,227 @@
 
 const char PROGRAM_TITLE[] = "coastline_gen version 0.5";
 
-#include <cstdlib>
-#include <algorithm>
-#include <stack>
+#include <string>
+#include <fstream>
+#include <sstream>
 
-#define cimg_plugin "CImg_skeleton.h"
+#include <sys/stat.h>
 
-#define cimg_use_tiff 1
-#define cimg_use_png 1
-#define cimg_display 0
+#include "coastline.h"
+#include "mapped.h"
+#include "coastline_cimg.h"
+#include "stages.h"
 
-#include "skeleton.h"
-#include "CImg.h"
+// loads a mask image, with Map uncompressed PGM and TIFF files are mapped
+// into memory and img shares the pixels of map.  writable allows modifying
+// img in memory.
+static void load_mask(const char *filename, CImg<unsigned char> &img, MappedRaster &map, const bool Map, const bool writable)
+{
+	if (Map && map.open(filename, writable))
+	{
+		img.assign(map.data(), map.width(), map.height(), 1, 1, true);
+		if (map.is_zero_copy())
+			std::fprintf(stderr,"  memory mapped %s\n", filename);
+		else
+			std::fprintf(stderr,"  memory mapped and assembled %s\n", filename);
+		return;
+	}
+	img = CImg<unsigned char>(filename);
+}
+
+// filename is the same file as the output or one of the batch outputs.
+// Such files must not be mapped, writing the output truncates the file
+// while the pixels are still used from the mapping.
+static bool is_output(const char *filename, const char *file_o, const std::vector<std::string> &outputs)
+{
+	struct stat st;
+	if ((filename == NULL) || (stat(filename, &st) != 0))
+		return false;
+
+	std::vector<std::string> files(outputs);
+	if (file_o != NULL)
+		files.push_back(file_o);
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		struct stat so;
+		if ((stat(files[i].c_str(), &so) == 0) && (so.st_dev == st.st_dev) && (so.st_ino == st.st_ino))
+		{
+			std::fprintf(stderr,"  %s is also written as output, not mapped\n", filename);
+			return true;
+		}
+	}
+	return false;
+}
+
+// load_mask() as stage of a StageGraph, so the input files are loaded
+// concurrently
+class LoadStage: public StageGraph::Stage
+{
+public:
+	LoadStage(const char *file, CImg<unsigned char> &image, MappedRaster &mapping, const bool Map, const bool Writable):
+		filename(file), img(image), map(mapping), use_map(Map), writable(Writable) {}
+
+	void run() { load_mask(filename, img, map, use_map, writable); }
+
+private:
+	const char *filename;
+	CImg<unsigned char> &img;
+	MappedRaster &map;
+	const bool use_map;
+	const bool writable;
+};
+
+/*
+ * Georeferencing of the vector output: the -gt option, the GeoTIFF tags or
+ * the world file of the input file, otherwise pixel coordinates.
+ */
+
+static void input_transform(const char *filename, const char *gt_string, GeoTransform &geo)
+{
+	if (gt_string != NULL)
+	{
+		double x0, dx, y0, dy;
+		if (std::sscanf(gt_string,"%lf:%lf:%lf:%lf",&x0,&dx,&y0,&dy) == 4)
+		{
+			geo.assign(x0, dx, y0, dy);
+			return;
+		}
+		std::fprintf(stderr,"  invalid transform %s, ignored.\n", gt_string);
+	}
+
+	if (MappedRaster::read_geotransform(filename, geo.gt))
+		std::fprintf(stderr,"  using GeoTIFF georeferencing of %s\n", filename);
+	else if (geo.read_world_file(filename))
+		std::fprintf(stderr,"  using world file of %s\n", filename);
+	else
+		std::fprintf(stderr,"  no georeferencing found, writing pixel coordinates\n");
+}
+
+// traces the land of each finished tile into the vector output, polygons
+// are split at the tile borders
+class VectorTileSink: public TileSink
+{
+public:
+	VectorTileSink(VectorWriter &writer, Profile &prof): W(writer), Prof(prof) {}
+
+	virtual void tile(const unsigned char *data, const long stride,
+	                  const int x0, const int y0, const int w, const int h)
+	{
+		Prof.begin("vectorize", (size_t)w*h);
+		const CImg<unsigned char> img(data, stride, h, 1, 1, true);
+		std::vector<ContourPolygon> polys;
+		img.get_crop(0, 0, w-1, h-1).trace_polygons(255, polys);
+		W.write(polys, x0, y0);
+		Prof.end();
+	}
+
+private:
+	VectorWriter &W;
+	Profile &Prof;
+};
 
-using namespace cimg_library;
+// -r option value
+static void parse_radius(const char *rad_string, Parameters &P)
+{
+	float *Radius = P.Radius;
+	int rc = std::sscanf(rad_string,"%f:%f:%f:%f:%f:%f:%f:%f",&Radius[0],&Radius[1],&Radius[2],&Radius[3],&Radius[4],&Radius[5],&Radius[6],&Radius[7]);
+
+	if (rc < 8) Radius[7] = 0.0;
+	if (rc < 7) Radius[6] = 0.0;
+	if (rc < 6) Radius[5] = 0.0;
+
+	if (Radius[6] <= 0.0) Radius[7] = 0.0;
+}
+
+// -is option value
+static void parse_islands(const char *is_string, Parameters &P)
+{
+	int *IThr = P.IThr;
+	std::sscanf(is_string,"%d:%d:%d:%d",&IThr[0],&IThr[1],&IThr[2],&IThr[3]);
+}
+
+// -dr option value, rectangles x0:y0:x1:y1 separated by commas
+static bool parse_rects(const char *rect_string, std::vector<Rect> &rects)
+{
+	std::istringstream rs(rect_string);
+	std::string item;
+	while (std::getline(rs, item, ','))
+	{
+		Rect r;
+		if (std::sscanf(item.c_str(),"%d:%d:%d:%d",&r.x0,&r.y0,&r.x1,&r.y1) != 4)
+		{
+			std::fprintf(stderr,"invalid rectangle %s.\n\n", item.c_str());
+			return false;
+		}
+		rects.push_back(r);
+	}
+	return true;
+}
+
+/*
+ * Batch file: one parameter set per line with the output file name followed
+ * by any of the options -r, -is, -l, -ls and -il, these replace the values
+ * from the command line.  Empty lines and lines starting with '#' are
+ * ignored.
+ */
+
+static bool read_batch(const char *filename, const Parameters &P0, std::vector<Parameters> &sets, std::vector<std::string> &outputs)
+{
+	std::ifstream f(filename);
+	if (!f)
+	{
+		std::fprintf(stderr,"could not open batch file %s.\n\n", filename);
+		return false;
+	}
+
+	std::string line;
+	int ln = 0;
+	while (std::getline(f, line))
+	{
+		ln++;
+		std::istringstream ls(line);
+		std::string output;
+		if (!(ls >> output) || (output[0] == '#'))
+			continue;
+
+		Parameters P = P0;
+		std::string opt, val;
+		while (ls >> opt)
+		{
+			if (!(ls >> val))
+			{
+				std::fprintf(stderr,"%s:%d: missing value of %s.\n\n", filename, ln, opt.c_str());
+				return false;
+			}
+			if (opt == "-r")
+				parse_radius(val.c_str(), P);
+			else if (opt == "-is")
+				parse_islands(val.c_str(), P);
+			else if (opt == "-l")
+				P.Level = std::atof(val.c_str());
+			else if (opt == "-ls")
+				P.SLevel = std::atof(val.c_str());
+			else if (opt == "-il")
+				P.ILevel = std::atof(val.c_str());
+			else
+			{
+				std::fprintf(stderr,"%s:%d: option %s not supported in batch files.\n\n", filename, ln, opt.c_str());
+				return false;
+			}
+		}
+		sets.push_back(P);
+		outputs.push_back(output);
+	}
+
+	if (sets.empty())
+	{
+		std::fprintf(stderr,"batch file %s contains no parameter sets.\n\n", filename);
+		return false;
+	}
+
+	return true;
+}
 
 int main(int argc,char **argv)
 {
@@ -65,6 +272,7 @@ int main(int argc,char **argv)
 
 	const char *file_f = cimg_option("-f",(char*)NULL,"fixed mask file");
 	const char *file_c = cimg_option("-c",(char*)NULL,"collapse mask file");
+	const char *file_v = cimg_option("-vo",(char*)NULL,"vector output file (GeoJSON, WKB with .wkb)");
 
 	const float Level = cimg_option("-l",0.5,"threshold level");
 	const float SLevel = cimg_option("-ls",0.5,"small feature threshold level");
@@ -76,1055 +284,299 @@ int main(int argc,char **argv)
 	const int FConRad = cimg_option("-fgr",0,"fixed gap connection radius");
 	const bool XCon = cimg_option("-xc",false,"extend connections");
 
-	float Radius[8];
+	Parameters P;
 	const char *rad_string = cimg_option("-r","4.0:2.5:1.0:0.5:1.0:0.0:0.0","generalization radius (normal:feature:min_water:min_land:island:collapse:collapse_mask:collapse_mask2)");
-	int rc = std::sscanf(rad_string,"%f:%f:%f:%f:%f:%f:%f:%f",&Radius[0],&Radius[1],&Radius[2],&Radius[3],&Radius[4],&Radius[5],&Radius[6],&Radius[7]);
+	parse_radius(rad_string, P);
 
-	if (rc < 8) Radius[7] = 0.0;
-	if (rc < 7) Radius[6] = 0.0;
-	if (rc < 6) Radius[5] = 0.0;
+	const char *is_string = cimg_option("-is","8:16:36:120","island size thresholds (skip:connect:expand:max)");
+	parse_islands(is_string, P);
 
-	if (Radius[6] <= 0.0) Radius[7] = 0.0;
+	const int TileSize = cimg_option("-t",0,"tile size for tiled processing (0=off)");
+	const int TileHalo = cimg_option("-th",-1,"tile overlap (-1=automatic)");
+	const int BlockSize = cimg_option("-nb",0,"narrow band block size (0=process the whole image)");
 
-	int IThr[4];
-	const char *is_string = cimg_option("-is","8:16:36:120","island size thresholds (skip:connect:expand:max)");
-	std::sscanf(is_string,"%d:%d:%d:%d",&IThr[0],&IThr[1],&IThr[2],&IThr[3]);
+	const char *gt_string = cimg_option("-gt",(char*)NULL,"vector output georeferencing (x0:dx:y0:dy of the upper left corner)");
+	const bool VectorTiles = cimg_option("-vt",false,"write vector output per tile in tiled processing");
+
+	const char *file_u = cimg_option("-u",(char*)NULL,"previous output mask file to update incrementally");
+	const char *file_pi = cimg_option("-pi",(char*)NULL,"previous input mask file for incremental update");
+	const char *rect_string = cimg_option("-dr",(char*)NULL,"changed rectangles for incremental update (x0:y0:x1:y1,...)");
+
+	const char *file_b = cimg_option("-b",(char*)NULL,"batch file with one output and parameter set per line");
+	const int BatchMemory = cimg_option("-bm",0,"memory limit in MB for concurrent batch processing (0=available memory)");
 
 	const bool Debug = cimg_option("-debug",false,"generate debug output");
+	const char *debug_images = cimg_option("-ds",(char*)NULL,"debug images to write (names without debug- and extension, comma separated, * matches any rest)");
+	const char *debug_window = cimg_option("-dw",(char*)NULL,"crop debug images to x0:y0:x1:y1");
+	const bool Map = cimg_option("-map",false,"memory map uncompressed input files");
+	const bool Profiling = cimg_option("-profile",false,"write per stage statistics to <output>.profile.json");
 
 	const bool helpflag = cimg_option("-h",false,"Display this help");
 	if (helpflag) std::exit(0);
 
-	if ((file_i == NULL) || (file_o == NULL))
+	if ((file_i == NULL) || ((file_o == NULL) && (file_v == NULL) && (file_b == NULL)))
 	{
 		std::fprintf(stderr,"You must specify input and output mask images files (try '%s -h').\n\n",argv[0]);
 		std::exit(1);
 	}
 
-	CImg<unsigned char> img_m;
-	CImg<unsigned char> img_co;
-	CImg<unsigned char> img_l;
-	CImg<unsigned char> img_sl;
-	CImg<unsigned char> img_sw;
-	CImg<unsigned char> img_b;
-	CImg<unsigned char> img_d;
-	CImg<unsigned char> img_f;
-	CImg<int> img_c;
-
-	std::fprintf(stderr,"Loading mask data...\n");
-	img_m = CImg<unsigned char>(file_i);
-
-	if (file_c != NULL)
+	if ((file_b != NULL) && (TileSize > 0))
 	{
-		std::fprintf(stderr,"Loading collapse mask data...\n");
-		img_co = CImg<unsigned char>(file_c);
+		std::fprintf(stderr,"batch (-b) and tiled (-t) processing can not be combined.\n\n");
+		std::exit(1);
 	}
 
-	if (file_f != NULL)
-	{
-		std::fprintf(stderr,"Loading fixed mask data...\n");
-		img_f = CImg<unsigned char>(file_f);
-
-		if ((img_f.width() != img_m.width()) || (img_f.height() != img_m.height()))
-		{
-			std::fprintf(stderr,"input (-i) and fixed mask (-f) images need to be the same size.\n\n");
-			std::exit(1);
-		}
-
-		std::fprintf(stderr,"Preprocessing fixed mask data...\n");
-
-		// repel
-		if (FS > 0)
-		{
-			CImg<unsigned char> morph_mask(FR*2 + 1, FR*2 + 1, 1, 1);
-
-			cimg_forXY(morph_mask,px,py)
-			{
-				int dx = px-(morph_mask.width()/2);
-				int dy = py-(morph_mask.height()/2);
-				if (std::sqrt(dx*dx+dy*dy) <= FR)
-					morph_mask(px,py) = 255;
-				else
-					morph_mask(px,py) = 0;
-			}
-
-			int cnte = 0;
-			int cnte2 = 0;
-			int cnte3 = 0;
-			int cnte4 = 0;
-
-			CImg<unsigned char> img_e = CImg<unsigned char>(img_m.width(), img_m.height(), 1, 1);
-
-			cimg_forXY(img_e,px,py)
-				img_e(px,py) = 0;
-
-			// expand connected areas
-			if (NGConnected && (FConRad == 0))
-			{
-				cimg_forXY(img_m,px,py)
-				{
-					if (img_m(px,py) == 255)
-					{
-						img_e(px,py) = 255;
-						for (int i = 1; i < 9; i++)
-						{
-							int xn = px + xo[i];
-							int yn = py + yo[i];
-							if (xn >= 0)
-								if (yn >= 0)
-									if (xn < img_m.width())
-										if (yn < img_m.height())
-											if (img_f(xn,yn) == 0)
-												if (img_m(xn,yn) != 255)
-												{
-													img_e(xn,yn) = 128;
-													cnte++;
-												}
-						}
-					}
-				}
-			}
-
-			// fix connections to fixed areas
-			if (FConRad > 0)
-			{
-				cimg_forXY(img_m,px,py)
-				{
-					if (img_m(px,py) == 255)
-					if (img_f(px,py) == 0)
-					if (img_e(px,py) == 0)
-					{
-						for (int i = 1; i < 9; i++)
-						{
-							int xn = px + xo[i];
-							int yn = py + yo[i];
-							if (xn >= 0)
-								if (yn >= 0)
-									if (xn < img_m.width())
-										if (yn < img_m.height())
-											if (img_f(xn,yn) != 0)
-												if (img_m(xn,yn) != 0)
-												if (img_m(xn,yn) != 255)
-												{
-													img_e(xn,yn) = 128;
-													img_m(xn,yn) = 255;
-													cnte4++;
-												}
-						}
-					}
-				}
-
-				cimg_forXY(img_m,px,py)
-				{
-					if (img_e(px,py) == 128)
-					{
-						for (int i = 1; i < 9; i++)
-						{
-							int xn = px + xo[i];
-							int yn = py + yo[i];
-							if (xn >= 0)
-								if (yn >= 0)
-									if (xn < img_m.width())
-										if (yn < img_m.height())
-											if (img_f(xn,yn) != 0)
-												if (img_m(xn,yn) != 0)
-												if (img_m(xn,yn) != 255)
-												{
-													img_e(xn,yn) = 80;
-													img_m(xn,yn) = 255;
-													cnte4++;
-												}
-						}
-					}
-				}
-
-				// look for nearest fixed within radius
-				for (int d=1; d <= FConRad; d++)
-				{
-					bool Found = false;
-					cimg_forXY(img_m,px,py)
-					{
-						bool Found = false;
-						if (img_m(px,py) == 255)
-						if (img_f(px,py) != 0)
-						{
-							for (int yn=py-d; yn <=py+d; yn++)
-								for (int xn=px-d; xn <=px+d; xn++)
-									if (!Found)
-										if (xn >= 0)
-											if (yn >= 0)
-												if (xn < img_m.width())
-													if (yn < img_m.height())
-														if ((std::abs(py-yn) <= d) || (std::abs(px-xn) <= d))
-															if (std::sqrt((px-xn)*(px-xn) + (py-yn)*(py-yn)) <= d)
-																if (img_f(xn,yn) == 0)
-																{
-																	unsigned char v = 180;
-																	img_e.draw_line(px, py, xn, yn, &v);
-																	v = 254;
-																	img_m.draw_line(px, py, xn, yn, &v);
-																	cnte2++;
-																	Found = true;
-																	break;
-																}
-						}
-					}
-				}
-
-				cimg_forXY(img_m,px,py)
-				{
-					if ((img_m(px,py) == 255) || (img_e(px,py) > 64))
-					{
-						for (int i = 1; i < 9; i++)
-						{
-							int xn = px + xo[i];
-							int yn = py + yo[i];
-							if (xn >= 0)
-								if (yn >= 0)
-									if (xn < img_m.width())
-										if (yn < img_m.height())
-											if (img_f(xn,yn) == 0)
-												if (img_m(xn,yn) != 255)
-												{
-													img_e(xn,yn) = 64;
-													img_m(xn,yn) = 254;
-													cnte3++;
-												}
-						}
-					}
-				}
-
-				if (XCon)
-					cimg_forXY(img_m,px,py)
-					{
-						if (img_e(px,py) == 64)
-						{
-							for (int i = 1; i < 9; i++)
-							{
-								int xn = px + xo[i];
-								int yn = py + yo[i];
-								if (xn >= 0)
-									if (yn >= 0)
-										if (xn < img_m.width())
-											if (yn < img_m.height())
-												if (img_f(xn,yn) == 0)
-													if (img_m(xn,yn) != 255)
-													{
-														img_e(xn,yn) = 32;
-														img_m(xn,yn) = 254;
-														cnte2++;
-													}
-							}
-						}
-					}
-
-				cimg_forXY(img_m,px,py)
-				{
-					if (img_m(px,py) == 254)
-						img_m(px,py) = 255;
-				}
-			}
-
-			if (Debug)
-				img_e.save("debug-em.tif");
-
-			std::fprintf(stderr,"  %d/%d/%d/%d pixels expanded\n", cnte, cnte2, cnte3, cnte4);
-
-			img_b = img_f.get_erode(morph_mask);
-
-			cimg_forXY(img_f,px,py)
-			{
-				if (img_f(px,py) > 0)
-				{
-					if (img_b(px,py) == 0)
-					{
-						img_f(px,py) = 128;
-						if (img_m(px,py) < 255)
-							img_m(px,py) = 0;
-					}
-					else
-						img_f(px,py) = 255;
-				}
-
-				if (img_m(px,py) > 0)
-				{
-					if (img_m(px,py) < 255)
-					{
-						if (img_f(px,py) < 255)
-							img_f(px,py) = 64;
-						img_m(px,py) = 255;
-					}
-					else
-					{
-						img_f(px,py) = 255;
-					}
-				}
-				img_b(px,py) = img_m(px,py);
-			}
-
-			if (NGConnected)
-			{
-				cimg_forXY(img_m,px,py)
-				{
-					if (img_e(px,py) != 0)
-					{
-						img_f(px,py) = 254;
-					}
-				}
-			}
-		}
-		else // attract
-		{
-			cimg_forXY(img_m,px,py)
-			{
-				if (img_m(px,py) > 0)
-					img_m(px,py) = 255;
-			}
-
-			img_b = img_m;
-
-			cimg_forXY(img_f,px,py)
-			{
-				if ((img_b(px,py) == 0) && (img_f(px,py) != 0))
-				{
-					bool found_m = false;
-					bool found_f = false;
-					for (int yn=py-FR; yn <=py+FR; yn++)
-					{
-						for (int xn=px-FR; xn <=px+FR; xn++)
-							if (xn >= 0)
-								if (yn >= 0)
-									if (xn < img_f.width())
-										if (yn < img_f.height())
-											if (std::sqrt((px-xn)*(px-xn) + (py-yn)*(py-yn)) <= FR)
-											{
-												if (img_f(xn,yn) == 0) found_f = true;
-												if (img_b(xn,yn) != 0) found_m = true;
-												if (found_m && found_f) break;
-											}
-						if (found_m && found_f) break;
-					}
-
-					if (found_m && found_f)
-					{
-						img_m(px,py) = 255;
-						for (int i = 1; i < 9; i++)
-						{
-							int xn = px + xo[i];
-							int yn = py + yo[i];
-							if (xn >= 0)
-								if (yn >= 0)
-									if (xn < img_f.width())
-										if (yn < img_f.height())
-											img_m(xn,yn) = 255;
-						}
-					}
-				}
-			}
-
-			img_b = img_m;
-		}
-
-		if (Debug)
-		{
-			img_f.save("debug-f.pgm");
-			img_m.save("debug-fm.pgm");
-		}
-	}
-	else
+	if ((file_b != NULL) && (file_v != NULL))
 	{
-		cimg_forXY(img_m,px,py)
-		{
-			if (img_m(px,py) > 0)
-				img_m(px,py) = 255;
-		}
-		img_b = img_m;
+		std::fprintf(stderr,"vector output (-vo) is not available in batch mode.\n\n");
+		std::exit(1);
 	}
 
-	img_sw = CImg<unsigned char>(img_m.width(), img_m.height(), 1, 1);
-	img_d = CImg<unsigned char>(img_m.width(), img_m.height(), 1, 1);
-	img_c = CImg<int>(img_m.width(), img_m.height(), 1, 1);
-
-	std::fprintf(stderr,"Measuring land areas...\n");
-
-	size_t cnt_all = 0;
-	size_t cnt_land = 0;
-
-	cimg_forXY(img_b,px,py)
+	if ((file_u != NULL) && ((file_b != NULL) || (TileSize > 0)))
 	{
-		cnt_all++;
-		if (img_b(px,py) == 255)
-		{
-			img_c(px,py) = 1;
-			img_d(px,py) = 48;
-			cnt_land++;
-		}
-		else
-		{
-			img_c(px,py) = 0;
-			img_d(px,py) = 0;
-		}
+		std::fprintf(stderr,"incremental update (-u) can not be combined with batch (-b) or tiled (-t) processing.\n\n");
+		std::exit(1);
 	}
 
-	if ((cnt_land == cnt_all) || (cnt_land == 0))
+	if ((file_u != NULL) && (file_pi == NULL) && (rect_string == NULL))
 	{
-		std::fprintf(stderr,"  data is trivial\n");
-
-		if (file_o != NULL)
-		{
-			std::fprintf(stderr,"Writing output...\n");
-			img_m.save(file_o);
-			std::fprintf(stderr,"coastline mask written to file %s\n", file_o);
-		}
-		return 0;
+		std::fprintf(stderr,"incremental update (-u) requires the previous input (-pi) or changed rectangles (-dr).\n\n");
+		std::exit(1);
 	}
 
-	if (Debug)
-		img_d.save("debug-dx.pgm");
-
-	int cntie = 0;
-	int cntie2 = 0;
-
-	std::fprintf(stderr,"Measuring islands...\n");
+	std::vector<Rect> rects;
+	if ((rect_string != NULL) && !parse_rects(rect_string, rects))
+		std::exit(1);
 
-	// measure islands and mark if too small
-	cimg_forXY(img_b,px,py)
+	Rect window = { 0, 0, -1, -1 };
+	if ((debug_window != NULL) &&
+	    ((std::sscanf(debug_window,"%d:%d:%d:%d",&window.x0,&window.y0,&window.x1,&window.y1) != 4) ||
+	     (window.x1 < window.x0) || (window.y1 < window.y0)))
 	{
-		if (img_b(px,py) == 255)
-		{
-			int c = img_b.floodfill4(px, py, 255, 128);
-			if (c < IThr[0])
-			{
-				img_b.floodfill4(px, py, 128, 64);
-				img_m.floodfill4(px, py, 255, 0);
-				img_c.floodfill4(px, py, 1, 0);
-				cntie++;
-			}
-			else if (c < IThr[1])
-			{
-				img_b.floodfill4(px, py, 128, 160);
-				img_m.floodfill4(px, py, 255, 0);
-				cntie2++;
-			}
-			else
-				img_c.floodfill4(px, py, 1, c);
-		}
+		std::fprintf(stderr,"invalid debug window %s.\n\n", debug_window);
+		std::exit(1);
 	}
 
-	if (Debug)
-		img_b.save("debug-ib.pgm");
-
-	std::fprintf(stderr,"  found %d/%d small islands.\n", cntie, cntie2);
-
-	if ((Radius[5] > 0.1) || (Radius[6] > 0.1))
+	if (VectorTiles && ((file_v == NULL) || (TileSize <= 0)))
 	{
-		std::fprintf(stderr,"Collapsing thin features (%.2f/%.2f/%.2f)...\n", Radius[5], Radius[6], Radius[7]);
-
-		int RI = int(Radius[6]+0.5);
-		CImg<unsigned char> morph_mask(RI*2 + 1, RI*2 + 1, 1, 1);
-
-		cimg_forXY(morph_mask,px,py)
-		{
-			int dx = px-(morph_mask.width()/2);
-			int dy = py-(morph_mask.height()/2);
-			if (std::sqrt(dx*dx+dy*dy) <= Radius[6])
-				morph_mask(px,py) = 255;
-			else
-				morph_mask(px,py) = 0;
-		}
-
-		CImg<float> img_dist = img_b.get_distance(0);
-
-		CImg<unsigned char> img_e = img_b.get_erode(morph_mask);
-		CImg<unsigned char> img_e2 = img_b;
-		CImg<unsigned char> img_ex = img_b;
-
-		cimg_forXY(img_b,px,py)
-		{
-			if (img_e(px,py) > 0) img_e(px,py) = 255;
-			if (img_e2(px,py) > 0) img_e2(px,py) = 255;
-			if (img_ex(px,py) > 0) img_ex(px,py) = 255;
-		}
-
-		cimg_forXY(img_b,px,py)
-		{
-			if (img_e2(px,py) == 255)
-				if (img_dist(px,py) < Radius[7])
-					img_e2(px,py) = 180;
-		}
-
-		cimg_forXY(img_b,px,py)
-		{
-			if (img_e2(px,py) == 255)
-				if (img_dist(px,py) >= Radius[7])
-					img_e2.floodfill4(px, py, 255, 128);
-		}
-
-		// disable collapse according to collapse mask
-		if (file_c != NULL)
-		{
-			img_co.dilate(morph_mask);
-		}
-
-		if (Debug)
-			img_e.save("debug-cl-e.tif");
-		if (Debug)
-			img_e2.save("debug-cl-e2.tif");
-
-		img_dist = img_e.get_distance(255);
-
-		if (Radius[5] > 0.1)
-		{
-			CImg<float> img_dist2 = img_b.get_distance(0);
-
-			cimg_forXY(img_b,px,py)
-			{
-				if (img_ex(px,py) == 255)
-					if (img_dist2(px,py) >= Radius[5])
-						img_ex.floodfill4(px, py, 255, 128);
-			}
-		}
-
-		int cntc = 0;
-		int cntc2 = 0;
-		int cntc3 = 0;
-
-		// collapse thin features
-		cimg_forXY(img_m,px,py)
-		{
-			if (img_b(px,py) == 0) continue;
-
-			if (Radius[5] > 0.1)
-			{
-				if (img_ex(px,py) != 128)
-				{
-					img_b(px,py) = 0;
-					img_m(px,py) = 0;
-					img_c(px,py) = 0;
-					img_d(px,py) = 64;
-					cntc++;
-				}
-			}
-			if (img_dist(px,py) > Radius[6]*8.0)
-			{
-				if (file_c != NULL)
-				{
-					if (img_co(px,py) != 0)
-					{
-						img_b(px,py) = 0;
-						img_m(px,py) = 0;
-						img_c(px,py) = 0;
-						img_d(px,py) = 128;
-						cntc2++;
-					}
-				}
-				else
-				{
-					img_b(px,py) = 0;
-					img_m(px,py) = 0;
-					img_c(px,py) = 0;
-					img_d(px,py) = 128;
-					cntc2++;
-				}
-			}
-			if (img_e2(px,py) != 128)
-			//if ((img_e2(px,py) != 180) && (img_dist(px,py) > Radius[6]))
-			{
-				if (file_c != NULL)
-				{
-					//if (img_c(px,py) >= IThr[3])
-					if (img_co(px,py) != 0)
-					{
-						img_b(px,py) = 0;
-						img_m(px,py) = 0;
-						img_c(px,py) = 0;
-						img_d(px,py) = 128;
-						cntc3++;
-					}
-				}
-				else //if (img_c(px,py) >= IThr[3])
-				{
-					img_b(px,py) = 0;
-					img_m(px,py) = 0;
-					img_c(px,py) = 0;
-					img_d(px,py) = 128;
-					cntc3++;
-				}
-			}
-		}
-
-		if (Debug)
-			img_d.save("debug-dcl.tif");
-
-		std::fprintf(stderr,"  %d/%d pixels collapsed.\n", cntc, cntc2, cntc3);
+		std::fprintf(stderr,"per tile vector output (-vt) requires -vo and tiled processing (-t).\n\n");
+		std::exit(1);
 	}
 
-	std::fprintf(stderr,"Analyzing small islands...\n");
-
-	cntie = 0;
-	int cxx = 0;
-
-	// look for nearest main land
-	for (int d=1; d < Radius[1]-0.0001; d++)
+	P.Level = Level;
+	P.SLevel = SLevel;
+	P.ILevel = ILevel;
+	P.FS = FS;
+	P.FR = FR;
+	P.NGConnected = NGConnected;
+	P.FConRad = FConRad;
+	P.XCon = XCon;
+	P.BlockSize = BlockSize;
+	P.Debug = Debug || (debug_images != NULL) || (debug_window != NULL);
+	P.DebugImages = debug_images;
+	P.DebugWindow = window;
+
+	std::vector<Parameters> sets;
+	std::vector<std::string> outputs;
+	if (file_b != NULL)
 	{
-		cimg_forXY(img_b,px,py)
-		{
-			bool Found = false;
-			if (img_c(px,py) == 1)
-			if (img_b(px,py) == 160)
-			{
-				for (int yn=py-d; yn <=py+d; yn++)
-					for (int xn=px-d; xn <=px+d; xn++)
-						if (!Found)
-							if (xn >= 0)
-								if (yn >= 0)
-									if (xn < img_c.width())
-										if (yn < img_c.height())
-											if ((std::abs(py-yn) == d) || (std::abs(px-xn) == d))
-												if (std::sqrt((px-xn)*(px-xn) + (py-yn)*(py-yn)) <= Radius[1])
-													if (img_m(xn,yn) == 255)
-													{
-														img_b.floodfill4(px, py, 160, 180);
-														img_c.floodfill4(px, py, 1, 0);
-														const unsigned char v = 255;
-														img_b.draw_line(px, py, xn, yn, &v);
-														img_b.draw_line(px+1, py, xn+1, yn, &v);
-														img_b.draw_line(px-1, py, xn-1, yn, &v);
-														cntie++;
-														Found = true;
-														break;
-													}
-													else
-													{
-														cxx++;
-														if (img_b(xn,yn) == 0) img_b(xn,yn) = 32;
-													}
-			}
-			else
-			{
-				img_b(px,py) = std::min(96, (int)img_b(px,py));
-			}
-		}
+		if (!read_batch(file_b, P, sets, outputs))
+			std::exit(1);
+		if (P.Debug)
+			std::fprintf(stderr,"  debug output is not available in batch mode.\n");
 	}
 
-	// transfer to main image
-	cimg_forXY(img_b,px,py)
-	{
-		if (img_b(px,py) > 128)
-		{
-			img_m(px,py) = 255;
-			img_d(px,py) = 255;
-		}
-	}
+	Profile Prof(Profiling);
 
-	if (Debug)
-		img_b.save("debug-ib2.pgm");
+	// the mappings need to outlive the images sharing their memory
+	MappedRaster map_m;
+	MappedRaster map_co;
+	MappedRaster map_f;
 
-	std::fprintf(stderr,"  connected %d small islands (%d tests).\n", cntie, cxx);
+	CImg<unsigned char> img_m;
+	CImg<unsigned char> img_co;
+	CImg<unsigned char> img_f;
+
+	// the previous output is not mapped since it is usually overwritten
+	MappedRaster map_u;
+	MappedRaster map_pi;
+	CImg<unsigned char> img_u;
+	CImg<unsigned char> img_pi;
 
-	std::fprintf(stderr,"Preparing skeletonization...\n");
+	Prof.begin("load", 0);
 
-	img_sl = CImg<unsigned char>(img_m);
+	LoadStage load_m(file_i, img_m, map_m, Map && !is_output(file_i, file_o, outputs), true);
+	LoadStage load_co(file_c, img_co, map_co, Map && !is_output(file_c, file_o, outputs), false);
+	LoadStage load_f(file_f, img_f, map_f, Map && !is_output(file_f, file_o, outputs), false);
+	LoadStage load_u(file_u, img_u, map_u, false, false);
+	LoadStage load_pi(file_pi, img_pi, map_pi, Map && !is_output(file_pi, file_o, outputs), false);
 
-	cimg_forXY(img_sl,px,py)
+	// every file is a separate output, so all of them load concurrently
+	StageGraph loads;
+	std::fprintf(stderr,"Loading mask data...\n");
+	loads.add(&load_m, 0, 1);
+	if (file_c != NULL)
+	{
+		std::fprintf(stderr,"Loading collapse mask data...\n");
+		loads.add(&load_co, 0, 2);
+	}
+	if (file_f != NULL)
 	{
-		img_sw(px,py) = 255-img_sl(px,py);
+		std::fprintf(stderr,"Loading fixed mask data...\n");
+		loads.add(&load_f, 0, 4);
 	}
-
-	img_sl.erode(2*Radius[0]);
-	img_sw.erode(2*Radius[0]);
-
-	if ((file_f != NULL) && (FS > 0))
+	if (file_u != NULL)
 	{
-		cimg_forXY(img_f,px,py)
+		std::fprintf(stderr,"Loading previous output...\n");
+		loads.add(&load_u, 0, 8);
+		if (file_pi != NULL)
 		{
-			if (img_f(px,py) < 254)
-			{
-				img_sl(px,py) = 0;
-				img_sw(px,py) = 255;
-			}
+			std::fprintf(stderr,"Loading previous input...\n");
+			loads.add(&load_pi, 0, 16);
 		}
 	}
+	loads.run();
 
-	if (Debug)
+	if ((file_c != NULL) && ((img_co.width() != img_m.width()) || (img_co.height() != img_m.height())))
 	{
-		img_sl.save("debug-raw-l.pgm");
-		img_sw.save("debug-raw-w.pgm");
+		std::fprintf(stderr,"input (-i) and collapse mask (-c) images need to be the same size.\n\n");
+		std::exit(1);
 	}
 
-	int csl1 = 0;
-	int csw1 = 0;
-	int csl2 = 0;
-	int csw2 = 0;
-
-	cimg_forXY(img_sl,px,py)
+	if ((file_f != NULL) && ((img_f.width() != img_m.width()) || (img_f.height() != img_m.height())))
 	{
-		if ((px > 1) && (py > 1) && (px < img_sl.width()-2) && (py < img_sl.height()-2))
-		{
-			if (img_sl(px,py) > 0)
-			{
-				img_sl(px,py) = 255;
-				csl1++;
-			}
-			else if (img_m(px,py) > 0)
-			{
-				img_sl(px,py) = 128;
-				csl2++;
-			}
-			else
-				img_sl(px,py) = 0;
-		}
-		else
-			img_sl(px,py) = 0;
-
-		if ((px > 1) && (py > 1) && (px < img_sw.width()-2) && (py < img_sw.height()-2))
-		{
-			if (img_sw(px,py) > 0)
-			{
-				img_sw(px,py) = 255;
-				csw1++;
-			}
-			else if (img_m(px,py) == 0)
-			{
-				img_sw(px,py) = 128;
-				csw2++;
-			}
-			else
-				img_sw(px,py) = 0;
-		}
-		else
-			img_sw(px,py) = 0;
+		std::fprintf(stderr,"input (-i) and fixed mask (-f) images need to be the same size.\n\n");
+		std::exit(1);
 	}
 
-	std::fprintf(stderr,"  land: %d fixed, %d variable.\n", csl1, csl2);
-	std::fprintf(stderr,"  water: %d fixed, %d variable.\n", csw1, csw2);
-
-	std::fprintf(stderr,"Skeletonizing...\n");
-
-	img_sl.thin(200, true);
-	img_sw.thin(200, true);
-
-	if (Debug)
+	if ((file_u != NULL) && ((img_u.width() != img_m.width()) || (img_u.height() != img_m.height())))
 	{
-		img_sl.save("debug-skel-l.pgm");
-		img_sw.save("debug-skel-w.pgm");
+		std::fprintf(stderr,"input (-i) and previous output (-u) images need to be the same size.\n\n");
+		std::exit(1);
 	}
 
-	std::fprintf(stderr,"Processing skeletons...\n");
-
+	if ((file_u != NULL) && (file_pi != NULL) && ((img_pi.width() != img_m.width()) || (img_pi.height() != img_m.height())))
 	{
-		CImg<unsigned char> img_snl = img_sl;
-		CImg<unsigned char> img_snw = img_sw;
-
-		// mark all junctions
-		cimg_forXY(img_snl,px,py)
-		{
-			if (img_snl(px,py) == 128)
-			{
-				img_d(px,py) = 128;
-
-				if (img_snl.n_adj(px,py) < 2)
-					img_sl(px,py) = 0;
-			}
-			else
-				img_sl(px,py) = 0;
-
-			if (img_snw(px,py) == 128)
-			{
-				img_d(px,py) = 80;
-
-				if (img_snw.n_adj(px,py) < 2)
-					img_sw(px,py) = 0;
-			}
-			else
-				img_sw(px,py) = 0;
-		}
+		std::fprintf(stderr,"input (-i) and previous input (-pi) images need to be the same size.\n\n");
+		std::exit(1);
 	}
 
-	std::fprintf(stderr,"Doing basic smoothing...\n");
-
-	img_b = img_m;
-	img_b.blur(Radius[0]);
-
-	if ((file_f != NULL) && (FS > 0))
+	VectorWriter vector_out;
+	if (file_v != NULL)
 	{
-		cimg_forXY(img_f,px,py)
+		GeoTransform geo;
+		input_transform(file_i, gt_string, geo);
+		if (!vector_out.open(file_v, VectorWriter::format_of(file_v), geo))
 		{
-			if (img_f(px,py) < 254)
-			{
-				img_b(px,py) = 0;
-			}
+			std::fprintf(stderr,"could not open vector output file %s.\n\n", file_v);
+			std::exit(1);
 		}
 	}
 
-	CImg<unsigned char> img_sl2 = img_sl;
-	CImg<unsigned char> img_sw2 = img_sw;
-	CImg<unsigned char> img_swx = img_sw;
-	CImg<unsigned char> img_slx = img_sl;
-
-	std::fprintf(stderr,"Shortening primary skeletons...\n");
+	Generalizer G;
 
-	for (int j=0; j < Radius[1]*1.6; j++)
+	if (file_b != NULL)
 	{
-		CImg<unsigned char> img_tmpl(img_sl);
-		CImg<unsigned char> img_tmpw(img_sw);
-		CImg<unsigned char> img_tmpl2(img_sl2);
-		CImg<unsigned char> img_tmplx(img_slx);
-		CImg<unsigned char> img_tmpw2(img_sw2);
-		cimg_forXY(img_sl,px,py)
+		std::vector< CImg<unsigned char> > img_r(sets.size());
+		std::vector<unsigned char *> results(sets.size());
+		for (size_t i = 0; i < sets.size(); i++)
 		{
-			if ((px > 2) && (py > 2) && (px < img_sl.width()-3) && (py < img_sl.height()-3))
-			{
-					if (img_tmplx(px,py) > 0)
-						if (img_tmplx.is_end3(px, py))
-						{
-							img_slx(px,py) = 0;
-						}
-
-				if (j < Radius[1]*1.2)
-				{
-					if (img_tmpl(px,py) > 0)
-						if (img_tmpl.is_end3(px, py))
-						{
-							img_sl(px,py) = 0;
-							img_d(px,py) = 200;
-						}
-					if (img_tmpw(px,py) > 0)
-						if (img_tmpw.is_end3(px, py))
-						{
-							img_sw(px,py) = 0;
-							img_d(px,py) = 200;
-						}
-				}
-				if (j < Radius[1]*0.5)
-				{
-					if (img_tmpw2(px,py) > 0)
-						if (img_tmpw2.is_end3(px, py))
-						{
-							img_sw2(px,py) = 0;
-							img_d(px,py) = 255;
-						}
-				}
-			}
+			img_r[i].assign(img_m.width(), img_m.height(), 1, 1);
+			results[i] = img_r[i].data();
 		}
-	}
 
-	if (Radius[2] == 0)
-	{
-		cimg_forXY(img_swx,px,py)
+		if (!G.run_batch(img_m.data(), img_m.width(), img_m.height(),
+		                 img_f.is_empty() ? NULL : img_f.data(),
+		                 img_co.is_empty() ? NULL : img_co.data(),
+		                 &sets[0], sets.size(), &results[0], BatchMemory, &Prof))
 		{
-			img_swx(px,py) = 0;
+			std::fprintf(stderr,"batch processing failed.\n\n");
+			std::exit(1);
 		}
-	}
-	else
-	{
-		std::fprintf(stderr,"Generating water base skeleton...\n");
 
-		int j=0;
-
-		while (true)
+		Prof.begin("write", img_m.size()*sets.size());
+		std::fprintf(stderr,"Writing output...\n");
+		for (size_t i = 0; i < sets.size(); i++)
 		{
-			std::fprintf(stderr,"  iteration %d...\n", j);
-			bool Found = false;
-			CImg<unsigned char> img_tmpw(img_swx);
-			cimg_forXY(img_swx,px,py)
-			{
-				if ((px > 2) && (py > 2) && (px < img_swx.width()-3) && (py < img_swx.height()-3))
-				{
-					if (img_tmpw(px,py) > 0)
-						if (img_tmpw.is_end3(px, py))
-						{
-							img_swx(px,py) = 0;
-							Found = true;
-						}
-				}
-			}
-			if (!Found) break;
-			j++;
-			if (j > Radius[2]*20) break;
+			img_r[i].save(outputs[i].c_str());
+			std::fprintf(stderr,"generalized mask written to file %s\n", outputs[i].c_str());
 		}
+		Prof.end();
 	}
-
-
-	if (Debug)
-	{
-		img_sl.save("debug-skel2-l.pgm");
-		img_sl2.save("debug-skel2-l2.pgm");
-		img_slx.save("debug-skel2-lx.pgm");
-		img_sw.save("debug-skel2-w.pgm");
-		img_sw2.save("debug-skel2-w2.pgm");
-		img_swx.save("debug-skel2-wx.pgm");
-	}
-
-	std::fprintf(stderr,"Dilating skeleton...\n");
-
-	float rsum = 0.0;
-
-	while (rsum < Radius[1]+0.01)
+	else if (file_u != NULL)
 	{
-		cimg_forXY(img_c,px,py)
+		if (!G.update(img_u.data(), img_m.data(), img_m.width(), img_m.height(),
+		              img_f.is_empty() ? NULL : img_f.data(),
+		              img_co.is_empty() ? NULL : img_co.data(),
+		              P, img_pi.is_empty() ? NULL : img_pi.data(),
+		              rects.empty() ? NULL : &rects[0], rects.size(), &Prof))
 		{
-			if (img_c(px,py) > 1)
-				if (img_c(px,py) < rsum*rsum*4.0)
-				if (img_c(px,py) < IThr[2])
-				{
-					img_sl(px,py) = 255;
-					img_sl2(px,py) = 255;
-				}
-		}
-
-		float r = std::min(float(1.0),Radius[1]-rsum);
-		if (r < 0.01) break;
-		std::fprintf(stderr,"  step 1 (%.2f)...\n", r);
-		img_sl.blur(r);
-		img_sw.blur(r);
-		if (rsum < Radius[1]*0.5)
-			img_sl2.blur(r);
-		if (rsum < Radius[1]*0.5)
-			img_sw2.blur(r);
-		if (rsum < Radius[2])
-			img_swx.blur(r);
-		if (rsum < Radius[3])
-			img_slx.blur(r);
-
-		cimg_forXY(img_sl,px,py)
-		{
-			if ((rsum < Radius[2]) && (img_swx(px,py) > 10))
-				img_swx(px,py)	= 255;
-			if ((rsum < Radius[3]) && (img_slx(px,py) > 10))
-				img_slx(px,py)	= 255;
-
-			{
-				if ((img_sl(px,py) > 10) && (img_sl(px,py) > img_sw(px,py)))
-					img_sl(px,py)	= 255;
-				else
-					img_sl(px,py)	= 0;
-
-				if (rsum < Radius[1]*0.5)
-					if ((img_sl2(px,py) > 10) && (img_sl2(px,py) > img_sw(px,py)) && (img_sl2(px,py) > img_sw2(px,py)))
-						img_sl2(px,py)	= 255;
-					else
-						img_sl2(px,py)	= 0;
-
-				if ((img_sw(px,py) > 10) && (img_sw(px,py) > img_sl(px,py)) && (img_sw(px,py) > img_sl2(px,py)))
-					img_sw(px,py)	= 255;
-				else
-					img_sw(px,py)	= 0;
-
-				if (rsum < Radius[1]*0.5)
-					if ((img_sw2(px,py) > 10) && (img_sw2(px,py) > img_sl(px,py)) && (img_sw2(px,py) > img_sl2(px,py)))
-						img_sw2(px,py)	= 255;
-					else
-						img_sw2(px,py)	= 0;
-			}
+			std::fprintf(stderr,"incremental update failed.\n\n");
+			std::exit(1);
 		}
 
-		rsum += r;
-	}
-
-	if (Debug)
-	{
-		img_sl.save("debug-skel3-l.pgm");
-		img_sl2.save("debug-skel3-l2.pgm");
-		img_slx.save("debug-skel3-lx.pgm");
-		img_sw.save("debug-skel3-w.pgm");
-		img_sw2.save("debug-skel3-w2.pgm");
-		img_swx.save("debug-skel3-wx.pgm");
+		// the result replaces the input from here on
+		img_m.swap(img_u);
 	}
-
+	else
 	{
-		CImg<int> img_tmpc = img_c.get_dilate(3);
-
-		cimg_forXY(img_m,px,py)
+		VectorTileSink sink(vector_out, Prof);
+		if (!G.run(img_m.data(), img_m.width(), img_m.height(),
+		           img_f.is_empty() ? NULL : img_f.data(),
+		           img_co.is_empty() ? NULL : img_co.data(),
+		           P, TileSize, TileHalo, &Prof, VectorTiles ? &sink : NULL))
 		{
-			if ((img_b(px,py) < (((img_tmpc(px,py)<IThr[3])&&(img_tmpc(px,py)>1))?SLevel*255:Level*255)) && (img_sl(px,py) == 0) && (img_sl2(px,py) == 0))
-				img_m(px,py) = 0;
-			else if (img_slx(px,py) != 0)
-				img_m(px,py) = 255;
-			else if ((img_sw(px,py) == 0) && (img_sw2(px,py) == 0) && (img_swx(px,py) == 0))
-				img_m(px,py) = 255;
-			else
-				img_m(px,py) = 0;
+			std::fprintf(stderr,"generalization failed.\n\n");
+			std::exit(1);
 		}
 	}
 
-	if (Debug)
-		img_m.save("debug-m.pgm");
-
-	std::fprintf(stderr,"Postprocessing Islands...\n");
-
-	cimg_forXY(img_c,px,py)
+	if ((file_o != NULL) && (file_b == NULL))
 	{
-		img_b(px,py) = 0;
-		if ((img_sw(px,py) == 0) && (img_sw2(px,py) == 0) && (img_swx(px,py) == 0))
-		if (img_c(px,py) > 1)
-		{
-			if (img_c(px,py) < IThr[2])
-			{
-				img_b(px,py) = 255;
-				img_d(px,py) = 180;
-			}
-			else if (img_c(px,py) < IThr[2]*3)
-			{
-				img_b(px,py) = 64;
-				img_d(px,py) = 160;
-			}
-			else if (img_c(px,py) < IThr[2]*8)
-			{
-				img_b(px,py) = 32;
-				img_d(px,py) = 140;
-			}
-		}
+		Prof.begin("write", img_m.size());
+		std::fprintf(stderr,"Writing output...\n");
+		img_m.save(file_o);
+		std::fprintf(stderr,"generalized mask written to file %s\n", file_o);
+		Prof.end();
 	}
 
-	img_b.blur(Radius[4]);
-
-	cimg_forXY(img_b,px,py)
+	if (file_v != NULL)
 	{
-		if (img_sw(px,py) == 0)
+		if (!VectorTiles)
 		{
-			if (img_sw2(px,py) == 0)
-			{
-				if (img_swx(px,py) == 0)
-				{
-					if (img_b(px,py) >= ILevel*255)
-						img_m(px,py) = 255;
-				}
-				else
-				{
-					if (img_b(px,py) >= ILevel*2*255)
-						img_m(px,py) = 255;
-				}
-			}
-			else
-			{
-				if (img_b(px,py) >= ILevel*3*255)
-					img_m(px,py) = 255;
-			}
+			Prof.begin("vectorize", img_m.size());
+			std::fprintf(stderr,"Tracing contours...\n");
+			std::vector<ContourPolygon> polys;
+			img_m.trace_polygons(255, polys);
+			vector_out.write(polys);
+			Prof.end();
 		}
-	}
 
-	if ((file_f != NULL) && (FS > 0))
-	{
-		cimg_forXY(img_f,px,py)
+		const size_t n = vector_out.polygons();
+		if (vector_out.close())
+			std::fprintf(stderr,"%ld polygons written to file %s\n", (long)n, file_v);
+		else
 		{
-			if (img_f(px,py) < 255)
-			{
-				if (img_f(px,py) == 254)
-					img_m(px,py) = 255;
-				else
-					img_m(px,py) = 0;
-			}
+			std::fprintf(stderr,"error writing vector output file %s.\n\n", file_v);
+			std::exit(1);
 		}
 	}
 
-	if (Debug)
-		img_d.save("debug-d.pgm");
-
-	if (file_o != NULL)
+	if (Prof.is_enabled())
 	{
-		std::fprintf(stderr,"Writing output...\n");
-		img_m.save(file_o);
-		std::fprintf(stderr,"generalized mask written to file %s\n", file_o);
+		int threads = 1;
+#ifdef _OPENMP
+		threads = omp_get_max_threads();
+#endif
+		char info[256];
+		std::snprintf(info, sizeof(info), "  \"width\": %d,\n  \"height\": %d,\n  \"threads\": %d,\n  \"tile_size\": %d",
+		              img_m.width(), img_m.height(), threads, TileSize);
+		const std::string filename = std::string((file_b != NULL) ? file_b : (file_o != NULL) ? file_o : file_v) + ".profile.json";
+		if (Prof.write_json(filename.c_str(), info))
+			std::fprintf(stderr,"profile written to file %s\n", filename.c_str());
+		else
+			std::fprintf(stderr,"  could not write profile to file %s\n", filename.c_str());
 	}
+
+	std::fprintf(stderr,"Peak memory use: %.1f MB\n", peak_rss_kb()/1024.0);
 }
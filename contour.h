@@ -0,0 +1,247 @@
+// polygon types and vector output of traced contours
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef CONTOUR_H
+#define CONTOUR_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+// polygon with rings of pixel corner coordinates (x0,y0,x1,y1,...), the
+// first ring is the outer boundary, the others are holes.  Rings are closed
+// implicitly and only contain the corners of the boundary.
+struct ContourPolygon
+{
+	std::vector< std::vector<int> > rings;
+};
+
+// affine transform from pixel corner to map coordinates like in GDAL:
+// x = gt[0] + px*gt[1] + py*gt[2], y = gt[3] + px*gt[4] + py*gt[5]
+struct GeoTransform
+{
+	double gt[6];
+
+	GeoTransform()
+	{
+		const double g[6] = { 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+		std::copy(g, g+6, gt);
+	}
+
+	// north up transform from the upper left corner and the pixel size
+	void assign(const double x0, const double dx, const double y0, const double dy)
+	{
+		const double g[6] = { x0, dx, 0.0, y0, 0.0, dy };
+		std::copy(g, g+6, gt);
+	}
+
+	// ESRI world file next to image_file (.tfw, .pgw, .pngw or .wld), the
+	// world file refers to pixel centers
+	bool read_world_file(const char *image_file)
+	{
+		std::string base(image_file);
+		std::string ext;
+		const size_t dot = base.rfind('.');
+		if ((dot != std::string::npos) && (base.find('/', dot) == std::string::npos))
+		{
+			ext = base.substr(dot+1);
+			base = base.substr(0, dot);
+		}
+
+		std::vector<std::string> names;
+		if (ext.size() >= 2)
+		{
+			names.push_back(base + "." + ext.substr(0,1) + ext.substr(ext.size()-1) + "w");
+			names.push_back(base + "." + ext + "w");
+		}
+		names.push_back(base + ".wld");
+
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			FILE *f = std::fopen(names[i].c_str(), "r");
+			if (f == NULL) continue;
+			double v[6];
+			int n = 0;
+			while ((n < 6) && (std::fscanf(f, "%lf", &v[n]) == 1))
+				n++;
+			std::fclose(f);
+			if (n < 6) continue;
+
+			// A D B E C F
+			const double g[6] = { v[4] - 0.5*v[0] - 0.5*v[2], v[0], v[2],
+			                      v[5] - 0.5*v[1] - 0.5*v[3], v[1], v[3] };
+			std::copy(g, g+6, gt);
+			return true;
+		}
+		return false;
+	}
+
+	void apply(const double px, const double py, double &x, double &y) const
+	{
+		x = gt[0] + px*gt[1] + py*gt[2];
+		y = gt[3] + px*gt[4] + py*gt[5];
+	}
+
+	// the transform mirrors, like the usual north up transform with gt[5] < 0
+	bool is_mirroring() const
+	{
+		return gt[1]*gt[5] - gt[2]*gt[4] < 0.0;
+	}
+};
+
+/*
+ * Writes polygons as GeoJSON FeatureCollection (one feature per polygon,
+ * outer rings counterclockwise as in RFC 7946) or as a single WKB
+ * MultiPolygon (little endian).  Polygons can be written in several parts,
+ * for example per tile, the file is completed by close().
+ */
+
+class VectorWriter
+{
+public:
+	enum Format { GEOJSON, WKB };
+
+	VectorWriter(): f(NULL), format(GEOJSON), count(0), count_pos(0) {}
+	~VectorWriter() { close(); }
+
+	// format from the file name: .wkb for WKB, GeoJSON otherwise
+	static Format format_of(const char *filename)
+	{
+		const size_t l = std::strlen(filename);
+		return ((l >= 4) && (std::strcmp(filename + l - 4, ".wkb") == 0)) ? WKB : GEOJSON;
+	}
+
+	bool open(const char *filename, const Format fmt, const GeoTransform &transform)
+	{
+		close();
+		f = std::fopen(filename, (fmt == WKB) ? "wb" : "w");
+		if (f == NULL) return false;
+		format = fmt;
+		geo = transform;
+		count = 0;
+
+		if (format == GEOJSON)
+			std::fprintf(f, "{\n\"type\": \"FeatureCollection\",\n\"features\": [\n");
+		else
+		{
+			put_byte(1);
+			put_uint32(6);
+			count_pos = std::ftell(f);
+			put_uint32(0);
+		}
+		return true;
+	}
+
+	// polygons with pixel coordinates relative to x0,y0
+	void write(const std::vector<ContourPolygon> &polys, const int x0 = 0, const int y0 = 0)
+	{
+		if (f == NULL) return;
+
+		// ring orientation in pixel coordinates (y down) is clockwise for
+		// outer rings, which becomes counterclockwise when mirrored
+		const bool reverse = !geo.is_mirroring();
+
+		for (size_t p = 0; p < polys.size(); p++)
+		{
+			const ContourPolygon &poly = polys[p];
+			if (poly.rings.empty()) continue;
+
+			if (format == GEOJSON)
+				std::fprintf(f, "%s{ \"type\": \"Feature\", \"properties\": {}, \"geometry\": { \"type\": \"Polygon\", \"coordinates\": [",
+				             (count > 0) ? ",\n" : "");
+			else
+			{
+				put_byte(1);
+				put_uint32(3);
+				put_uint32(poly.rings.size());
+			}
+
+			for (size_t r = 0; r < poly.rings.size(); r++)
+			{
+				const std::vector<int> &ring = poly.rings[r];
+				const size_t n = ring.size()/2;
+
+				if (format == GEOJSON)
+					std::fprintf(f, "%s[", (r > 0) ? ", " : "");
+				else
+					put_uint32(n+1);
+
+				// closed with the first point repeated
+				for (size_t i = 0; i <= n; i++)
+				{
+					const size_t j = reverse ? (n - (i % n)) % n : (i % n);
+					double x, y;
+					geo.apply(ring[2*j] + x0, ring[2*j+1] + y0, x, y);
+					if (format == GEOJSON)
+						std::fprintf(f, "%s[%.12g,%.12g]", (i > 0) ? "," : "", x, y);
+					else
+					{
+						put_double(x);
+						put_double(y);
+					}
+				}
+
+				if (format == GEOJSON)
+					std::fprintf(f, "]");
+			}
+
+			if (format == GEOJSON)
+				std::fprintf(f, "] } }");
+			count++;
+		}
+	}
+
+	// completes the file, false on write errors
+	bool close()
+	{
+		if (f == NULL) return true;
+
+		if (format == GEOJSON)
+			std::fprintf(f, "\n]\n}\n");
+		else
+		{
+			std::fseek(f, count_pos, SEEK_SET);
+			put_uint32(count);
+		}
+
+		const bool ok = !std::ferror(f);
+		const bool closed = (std::fclose(f) == 0);
+		f = NULL;
+		return ok && closed;
+	}
+
+	size_t polygons() const { return count; }
+
+private:
+	FILE *f;
+	Format format;
+	GeoTransform geo;
+	size_t count;
+	long count_pos;
+
+	void put_byte(const unsigned char b) { std::fputc(b, f); }
+
+	void put_uint32(const uint32_t v)
+	{
+		unsigned char b[4];
+		for (int i = 0; i < 4; i++)
+			b[i] = (v >> (8*i)) & 0xff;
+		std::fwrite(b, 1, 4, f);
+	}
+
+	void put_double(const double d)
+	{
+		uint64_t v;
+		std::memcpy(&v, &d, 8);
+		unsigned char b[8];
+		for (int i = 0; i < 8; i++)
+			b[i] = (v >> (8*i)) & 0xff;
+		std::fwrite(b, 1, 8, f);
+	}
+};
+
+#endif
@@ -0,0 +1,168 @@
+// background writer of debug images
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <cstring>
+#include <cstdio>
+
+/*
+ * Writes the debug images of generalize() from a separate thread.  save()
+ * only copies the image (cropped to the window if set) to a queue, when
+ * the queue holds Length images it waits for the writer.  Images are only
+ * written if their name matches the selection: a comma separated list of
+ * names without "debug-" and the extension, a trailing * matches any
+ * rest, for example "skel2-*,d".  A NULL selection matches all images.
+ */
+
+class DebugWriter
+{
+public:
+	DebugWriter(const char *Select, const Rect &Window, const int Length = 4):
+		select((Select != NULL) ? Select : "*"), window(Window), length(Length), done(false), running(false)
+	{
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&queued, NULL);
+		pthread_cond_init(&taken, NULL);
+	}
+
+	~DebugWriter()
+	{
+		finish();
+		pthread_cond_destroy(&taken);
+		pthread_cond_destroy(&queued);
+		pthread_mutex_destroy(&mutex);
+	}
+
+	// the image of file name is selected
+	bool wants(const char *filename) const
+	{
+		std::string name(filename);
+		if (name.compare(0, 6, "debug-") == 0)
+			name = name.substr(6);
+		const size_t dot = name.rfind('.');
+		if (dot != std::string::npos)
+			name = name.substr(0, dot);
+
+		size_t pos = 0;
+		while (pos <= select.size())
+		{
+			size_t end = select.find(',', pos);
+			if (end == std::string::npos) end = select.size();
+			const std::string item = select.substr(pos, end-pos);
+			if (!item.empty() && (item[item.size()-1] == '*'))
+			{
+				if (name.compare(0, item.size()-1, item, 0, item.size()-1) == 0)
+					return true;
+			}
+			else if (item == name)
+				return true;
+			pos = end+1;
+		}
+		return false;
+	}
+
+	// queues img for writing to filename
+	void save(const CImg<unsigned char> &img, const char *filename)
+	{
+		if (!wants(filename)) return;
+
+		Job job;
+		job.filename = filename;
+		if (window.x1 >= window.x0)
+			job.img = img.get_crop(window.x0, window.y0, window.x1, window.y1);
+		else
+			job.img = img;
+
+		pthread_mutex_lock(&mutex);
+		if (!running)
+		{
+			done = false;
+			running = (pthread_create(&thread, NULL, writer, this) == 0);
+		}
+		if (running)
+		{
+			while ((int)jobs.size() >= length)
+				pthread_cond_wait(&taken, &mutex);
+			jobs.push_back(Job());
+			jobs.back().filename.swap(job.filename);
+			jobs.back().img.swap(job.img);
+			pthread_cond_signal(&queued);
+		}
+		pthread_mutex_unlock(&mutex);
+
+		// no thread available, write directly
+		if (!job.img.is_empty())
+			job.img.save(job.filename.c_str());
+	}
+
+	// waits until all queued images are written
+	void finish()
+	{
+		pthread_mutex_lock(&mutex);
+		const bool wait = running;
+		done = true;
+		pthread_cond_signal(&queued);
+		pthread_mutex_unlock(&mutex);
+
+		if (wait)
+		{
+			pthread_join(thread, NULL);
+			running = false;
+		}
+	}
+
+private:
+	struct Job
+	{
+		std::string filename;
+		CImg<unsigned char> img;
+	};
+
+	std::string select;
+	Rect window;
+	int length;
+	bool done;
+	bool running;
+
+	std::deque<Job> jobs;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t queued;
+	pthread_cond_t taken;
+
+	static void *writer(void *arg)
+	{
+		DebugWriter *w = (DebugWriter *)arg;
+		for (;;)
+		{
+			Job job;
+			pthread_mutex_lock(&w->mutex);
+			while (w->jobs.empty() && !w->done)
+				pthread_cond_wait(&w->queued, &w->mutex);
+			if (w->jobs.empty())
+			{
+				pthread_mutex_unlock(&w->mutex);
+				break;
+			}
+			job.filename.swap(w->jobs.front().filename);
+			job.img.swap(w->jobs.front().img);
+			w->jobs.pop_front();
+			pthread_cond_signal(&w->taken);
+			pthread_mutex_unlock(&w->mutex);
+
+			job.img.save(job.filename.c_str());
+		}
+		return NULL;
+	}
+
+	DebugWriter(const DebugWriter &);
+	DebugWriter &operator=(const DebugWriter &);
+};
+
+#endif
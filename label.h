@@ -0,0 +1,74 @@
+// types and helpers for connected component labeling
+// Copyright 2012 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef LABEL_H
+#define LABEL_H
+
+#include <vector>
+#include <cstddef>
+
+// statistics of a connected component: pixel count and bounding box
+struct ComponentStats
+{
+	size_t area;
+	int x0, y0, x1, y1;
+
+	ComponentStats(): area(0), x0(0), y0(0), x1(-1), y1(-1) {}
+
+	void add(int x, int y)
+	{
+		if (area == 0)
+		{
+			x0 = x1 = x;
+			y0 = y1 = y;
+		}
+		else
+		{
+			if (x < x0) x0 = x;
+			if (x > x1) x1 = x;
+			if (y < y0) y0 = y;
+			if (y > y1) y1 = y;
+		}
+		area++;
+	}
+
+	void add(const ComponentStats &s)
+	{
+		if (s.area == 0) return;
+		if (area == 0)
+		{
+			*this = s;
+			return;
+		}
+		if (s.x0 < x0) x0 = s.x0;
+		if (s.x1 > x1) x1 = s.x1;
+		if (s.y0 < y0) y0 = s.y0;
+		if (s.y1 > y1) y1 = s.y1;
+		area += s.area;
+	}
+};
+
+// union find on label equivalences, roots are always the smallest label
+// of a set so labels keep the order of their first occurrence
+inline unsigned int uf_find(std::vector<unsigned int> &parent, unsigned int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+inline void uf_union(std::vector<unsigned int> &parent, unsigned int a, unsigned int b)
+{
+	a = uf_find(parent, a);
+	b = uf_find(parent, b);
+	if (a < b)
+		parent[b] = a;
+	else if (b < a)
+		parent[a] = b;
+}
+
+#endif
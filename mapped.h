@@ -0,0 +1,413 @@
+// memory mapped input of uncompressed raster files
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Byte valued single channel images from binary PGM (P5) and uncompressed
+ * TIFF or BigTIFF files (first image of the file) are mapped into memory
+ * instead of being decoded.  If the rows are stored contiguously (PGM,
+ * TIFF with a single strip or strips following each other) data() points
+ * into the mapping, so nothing is read before the pixels are accessed.
+ * Other layouts (tiled TIFF, scattered strips) are assembled into a buffer
+ * from the mapping.
+ *
+ * With writable set the mapping is private (copy on write): the pixels can
+ * be modified in memory, pages are only copied when written and the file is
+ * never changed.
+ *
+ * open() returns false for all other files and formats, these have to be
+ * loaded conventionally.
+ *
+ * The GeoTIFF georeferencing (ModelTransformation or ModelTiepoint with
+ * ModelPixelScale, pixel is area) is available as a GDAL style geotransform
+ * with read_geotransform(), also from TIFF files that can not be mapped.
+ */
+
+class MappedRaster
+{
+public:
+	MappedRaster(): base(NULL), length(0), pixels(NULL), w(0), h(0), has_gt(false) {}
+	~MappedRaster() { close(); }
+
+	bool open(const char *filename, const bool writable = false)
+	{
+		if (!map(filename, writable))
+			return false;
+
+		if (!open_pgm() && !open_tiff())
+		{
+			close();
+			return false;
+		}
+
+		// the mapping is not needed any more if the pixels were assembled
+		if (!buffer.empty())
+		{
+			munmap(base, length);
+			base = NULL;
+			length = 0;
+		}
+		return true;
+	}
+
+	// geotransform gt (x = gt[0] + px*gt[1] + py*gt[2], y = gt[3] + px*gt[4] +
+	// py*gt[5] for pixel corner px,py) of a GeoTIFF file
+	static bool read_geotransform(const char *filename, double *gt)
+	{
+		MappedRaster m;
+		if (!m.map(filename, false))
+			return false;
+		m.open_tiff();
+		if (!m.has_gt)
+			return false;
+		std::copy(m.gt, m.gt+6, gt);
+		return true;
+	}
+
+	void close()
+	{
+		if (base != NULL)
+			munmap(base, length);
+		base = NULL;
+		length = 0;
+		pixels = NULL;
+		w = h = 0;
+		has_gt = false;
+		std::vector<unsigned char>().swap(buffer);
+	}
+
+	unsigned char *data() { return pixels; }
+	const unsigned char *data() const { return pixels; }
+	int width() const { return w; }
+	int height() const { return h; }
+
+	// the pixels are read from the mapping directly
+	bool is_zero_copy() const { return (pixels != NULL) && buffer.empty(); }
+
+private:
+	unsigned char *base;
+	size_t length;
+	unsigned char *pixels;
+	int w, h;
+	std::vector<unsigned char> buffer;
+	bool has_gt;
+	double gt[6];
+
+	bool map(const char *filename, const bool writable)
+	{
+		close();
+
+		const int fd = ::open(filename, O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if ((fstat(fd, &st) != 0) || (st.st_size < 8))
+		{
+			::close(fd);
+			return false;
+		}
+
+		length = st.st_size;
+		const int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+		void *m = mmap(NULL, length, prot, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (m == MAP_FAILED)
+		{
+			length = 0;
+			return false;
+		}
+		base = (unsigned char *)m;
+		return true;
+	}
+
+	// --- PGM ---
+
+	// next number of the PGM header at pos, skipping white space and comments
+	bool pgm_number(size_t &pos, long &v) const
+	{
+		while (pos < length)
+		{
+			if (base[pos] == '#')
+				while ((pos < length) && (base[pos] != '\n')) pos++;
+			else if ((base[pos] == ' ') || (base[pos] == '\t') || (base[pos] == '\r') || (base[pos] == '\n'))
+				pos++;
+			else
+				break;
+		}
+		if ((pos >= length) || (base[pos] < '0') || (base[pos] > '9'))
+			return false;
+		v = 0;
+		while ((pos < length) && (base[pos] >= '0') && (base[pos] <= '9'))
+		{
+			v = 10*v + (base[pos] - '0');
+			if (v > INT_MAX) return false;
+			pos++;
+		}
+		return true;
+	}
+
+	bool open_pgm()
+	{
+		if ((base[0] != 'P') || (base[1] != '5'))
+			return false;
+
+		size_t pos = 2;
+		long xsize, ysize, maxval;
+		if (!pgm_number(pos, xsize) || !pgm_number(pos, ysize) || !pgm_number(pos, maxval))
+			return false;
+		// a single white space character separates header and data
+		pos++;
+		if (pos > length)
+			return false;
+		if ((xsize <= 0) || (ysize <= 0) || (maxval <= 0) || (maxval > 255))
+			return false;
+		if ((double)xsize*ysize > (double)(length - pos))
+			return false;
+
+		w = xsize;
+		h = ysize;
+		pixels = base + pos;
+		return true;
+	}
+
+	// --- TIFF ---
+
+	bool big_endian;
+	bool big_tiff;
+
+	// size bytes at pos are inside the file, offsets from the file can be
+	// arbitrary so pos + size is not formed
+	bool inside(const uint64_t pos, const uint64_t size) const
+	{
+		return (pos <= length) && (size <= length - pos);
+	}
+
+	uint64_t get(const uint64_t pos, const int size) const
+	{
+		if (!inside(pos, size)) return 0;
+		uint64_t v = 0;
+		for (int i = 0; i < size; i++)
+		{
+			const int b = big_endian ? i : size-1-i;
+			v = (v << 8) | base[pos + b];
+		}
+		return v;
+	}
+
+	static int type_size(const int type)
+	{
+		switch (type)
+		{
+			case 1: case 2: case 6: case 7: return 1; // BYTE, ASCII, SBYTE, UNDEFINED
+			case 3: case 8: return 2;                 // SHORT, SSHORT
+			case 4: case 9: case 11: case 13: return 4; // LONG, SLONG, FLOAT, IFD
+			case 16: case 17: case 18: return 8;      // LONG8, SLONG8, IFD8
+		}
+		return 0;
+	}
+
+	// values of an integer IFD entry
+	bool tag_values(const uint64_t entry, std::vector<uint64_t> &values) const
+	{
+		const int type = get(entry + 2, 2);
+		const int size = type_size(type);
+		if ((size == 0) || (type == 11)) return false;
+		const uint64_t count = get(entry + 4, big_tiff ? 8 : 4);
+		const int inline_size = big_tiff ? 8 : 4;
+		const uint64_t value_pos = entry + (big_tiff ? 12 : 8);
+		if (count > length/size) return false;
+		const uint64_t pos = (count*size <= (uint64_t)inline_size) ? value_pos : get(value_pos, inline_size);
+		if (!inside(pos, count*size)) return false;
+		values.resize(count);
+		for (uint64_t i = 0; i < count; i++)
+			values[i] = get(pos + i*size, size);
+		return true;
+	}
+
+	// values of a DOUBLE IFD entry
+	bool tag_doubles(const uint64_t entry, std::vector<double> &values) const
+	{
+		if (get(entry + 2, 2) != 12) return false;
+		const uint64_t count = get(entry + 4, big_tiff ? 8 : 4);
+		const int inline_size = big_tiff ? 8 : 4;
+		const uint64_t value_pos = entry + (big_tiff ? 12 : 8);
+		if (count > length/8) return false;
+		const uint64_t pos = (count*8 <= (uint64_t)inline_size) ? value_pos : get(value_pos, inline_size);
+		if (!inside(pos, count*8)) return false;
+		values.resize(count);
+		for (uint64_t i = 0; i < count; i++)
+		{
+			const uint64_t b = get(pos + i*8, 8);
+			std::memcpy(&values[i], &b, 8);
+		}
+		return true;
+	}
+
+	bool open_tiff()
+	{
+		if ((base[0] == 'I') && (base[1] == 'I'))
+			big_endian = false;
+		else if ((base[0] == 'M') && (base[1] == 'M'))
+			big_endian = true;
+		else
+			return false;
+
+		const int magic = get(2, 2);
+		if (magic == 42)
+			big_tiff = false;
+		else if ((magic == 43) && (get(4, 2) == 8))
+			big_tiff = true;
+		else
+			return false;
+
+		const uint64_t ifd = big_tiff ? get(8, 8) : get(4, 4);
+		const uint64_t n = get(ifd, big_tiff ? 8 : 2);
+		const int entry_size = big_tiff ? 20 : 12;
+		const uint64_t entries = ifd + (big_tiff ? 8 : 2);
+		if ((n == 0) || (n > length/entry_size) || !inside(entries, n*entry_size))
+			return false;
+
+		uint64_t xsize = 0, ysize = 0, rows_per_strip = 0, tile_w = 0, tile_h = 0;
+		uint64_t bits = 1, spp = 1, compression = 1, photometric = 1, format = 1;
+		std::vector<uint64_t> offsets, v;
+		std::vector<double> scale, tiepoint, transform;
+		bool tiled = false;
+
+		for (uint64_t i = 0; i < n; i++)
+		{
+			const uint64_t e = entries + i*entry_size;
+			const int tag = get(e, 2);
+			switch (tag)
+			{
+				case 256: case 257: case 258: case 259: case 262: case 277:
+				case 278: case 322: case 323: case 339:
+					if (!tag_values(e, v) || v.empty()) return false;
+					if (tag == 256) xsize = v[0];
+					else if (tag == 257) ysize = v[0];
+					else if (tag == 258) bits = v[0];
+					else if (tag == 259) compression = v[0];
+					else if (tag == 262) photometric = v[0];
+					else if (tag == 277) spp = v[0];
+					else if (tag == 278) rows_per_strip = v[0];
+					else if (tag == 322) tile_w = v[0];
+					else if (tag == 323) tile_h = v[0];
+					else if (tag == 339) format = v[0];
+					break;
+				case 273: case 324:
+					if (!tag_values(e, offsets)) return false;
+					tiled = (tag == 324);
+					break;
+				case 33550:
+					tag_doubles(e, scale);
+					break;
+				case 33922:
+					tag_doubles(e, tiepoint);
+					break;
+				case 34264:
+					tag_doubles(e, transform);
+					break;
+			}
+		}
+
+		if (transform.size() >= 8)
+		{
+			const double g[6] = { transform[3], transform[0], transform[1], transform[7], transform[4], transform[5] };
+			std::copy(g, g+6, gt);
+			has_gt = true;
+		}
+		else if ((scale.size() >= 2) && (tiepoint.size() >= 6))
+		{
+			const double g[6] = { tiepoint[3] - tiepoint[0]*scale[0], scale[0], 0.0,
+			                      tiepoint[4] + tiepoint[1]*scale[1], 0.0, -scale[1] };
+			std::copy(g, g+6, gt);
+			has_gt = true;
+		}
+
+		// 8 bit unsigned gray values (black is zero) without compression
+		if ((bits != 8) || (spp != 1) || (compression != 1) || (format != 1) || (photometric != 1))
+			return false;
+		if ((xsize == 0) || (ysize == 0) || (xsize > INT_MAX) || (ysize > INT_MAX))
+			return false;
+		if (offsets.empty())
+			return false;
+
+		w = xsize;
+		h = ysize;
+
+		if (!tiled)
+		{
+			if ((rows_per_strip == 0) || (rows_per_strip > ysize))
+				rows_per_strip = ysize;
+			const uint64_t nstrips = (ysize + rows_per_strip - 1)/rows_per_strip;
+			if (offsets.size() < nstrips)
+				return false;
+
+			// strips need to be complete and inside the file
+			bool contiguous = true;
+			for (uint64_t s = 0; s < nstrips; s++)
+			{
+				const uint64_t rows = std::min(rows_per_strip, ysize - s*rows_per_strip);
+				if (!inside(offsets[s], rows*xsize))
+					return false;
+				if (offsets[s] != offsets[0] + s*rows_per_strip*xsize)
+					contiguous = false;
+			}
+
+			if (contiguous)
+			{
+				pixels = base + offsets[0];
+				return true;
+			}
+
+			buffer.resize(xsize*ysize);
+			for (uint64_t s = 0; s < nstrips; s++)
+			{
+				const uint64_t rows = std::min(rows_per_strip, ysize - s*rows_per_strip);
+				std::memcpy(&buffer[s*rows_per_strip*xsize], base + offsets[s], rows*xsize);
+			}
+		}
+		else
+		{
+			if ((tile_w == 0) || (tile_h == 0) || (tile_w > length) || (tile_h > length/tile_w))
+				return false;
+			const uint64_t ntx = (xsize + tile_w - 1)/tile_w;
+			const uint64_t nty = (ysize + tile_h - 1)/tile_h;
+			if (offsets.size() < ntx*nty)
+				return false;
+
+			// tiles are complete including the padding beyond the image
+			for (uint64_t t = 0; t < ntx*nty; t++)
+				if (!inside(offsets[t], tile_w*tile_h))
+					return false;
+
+			buffer.resize(xsize*ysize);
+			for (uint64_t ty = 0; ty < nty; ty++)
+				for (uint64_t tx = 0; tx < ntx; tx++)
+				{
+					const unsigned char *src = base + offsets[ty*ntx + tx];
+					const uint64_t cols = std::min(tile_w, xsize - tx*tile_w);
+					const uint64_t rows = std::min(tile_h, ysize - ty*tile_h);
+					for (uint64_t y = 0; y < rows; y++)
+						std::memcpy(&buffer[(ty*tile_h + y)*xsize + tx*tile_w], src + y*tile_w, cols);
+				}
+		}
+
+		pixels = &buffer[0];
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,125 @@
+// block occupancy index of land water masks
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <vector>
+#include <algorithm>
+
+/*
+ * Classifies the blocks of size*size pixels of a mask as water (all pixels
+ * 0), land (all pixels > 0) or mixed.  Blocks where the fixed mask is
+ * active (< 255) count as mixed.  A block is active if it is mixed or next
+ * to a block of a different class, everything further than the influence
+ * radius from all active blocks is known to stay as it is: water remains
+ * water and land becomes 255.
+ */
+
+class Occupancy
+{
+public:
+	enum State { WATER = 0, LAND = 1, MIXED = 2 };
+
+	Occupancy(): bs(0), nbx(0), nby(0) {}
+
+	void assign(const unsigned char *mask, const unsigned char *fixed, const int xsize, const int ysize, const int size)
+	{
+		bs = size;
+		nbx = (xsize+bs-1)/bs;
+		nby = (ysize+bs-1)/bs;
+		states.assign((size_t)nbx*nby, WATER);
+
+#pragma omp parallel for schedule(dynamic)
+		for (int by = 0; by < nby; by++)
+		{
+			const int y0 = by*bs;
+			const int y1 = std::min(y0+bs, ysize);
+			for (int bx = 0; bx < nbx; bx++)
+			{
+				const int x0 = bx*bs;
+				const int x1 = std::min(x0+bs, xsize);
+				bool land = false;
+				bool water = false;
+				bool fix = false;
+				for (int y = y0; y < y1; y++)
+				{
+					const unsigned char *m = mask + (size_t)y*xsize;
+					for (int x = x0; x < x1; x++)
+					{
+						if (m[x] > 0) land = true;
+						else water = true;
+					}
+					if (fixed != NULL)
+					{
+						const unsigned char *f = fixed + (size_t)y*xsize;
+						for (int x = x0; x < x1; x++)
+							if (f[x] < 255) fix = true;
+					}
+					if (fix || (land && water)) break;
+				}
+				states[(size_t)by*nbx + bx] = (fix || (land && water)) ? MIXED : (land ? LAND : WATER);
+			}
+		}
+
+		active.assign(states.size(), 0);
+		for (int by = 0; by < nby; by++)
+			for (int bx = 0; bx < nbx; bx++)
+			{
+				const unsigned char s = state(bx, by);
+				bool a = (s == MIXED);
+				for (int yn = std::max(by-1, 0); !a && (yn <= std::min(by+1, nby-1)); yn++)
+					for (int xn = std::max(bx-1, 0); xn <= std::min(bx+1, nbx-1); xn++)
+						if (state(xn, yn) != s) a = true;
+				active[(size_t)by*nbx + bx] = a ? 1 : 0;
+			}
+	}
+
+	int size() const { return bs; }
+	int blocks_x() const { return nbx; }
+	int blocks_y() const { return nby; }
+
+	unsigned char state(const int bx, const int by) const { return states[(size_t)by*nbx + bx]; }
+	bool is_active(const int bx, const int by) const { return active[(size_t)by*nbx + bx] != 0; }
+
+	// the final value of the pixels of an inactive block
+	unsigned char known(const int bx, const int by) const { return (state(bx, by) == LAND) ? 255 : 0; }
+
+	// any block overlapping the pixel rectangle x0,y0-x1,y1 is active
+	bool any_active(const int x0, const int y0, const int x1, const int y1) const
+	{
+		for (int by = y0/bs; by <= y1/bs; by++)
+			for (int bx = x0/bs; bx <= x1/bs; bx++)
+				if (is_active(bx, by))
+					return true;
+		return false;
+	}
+
+	// band[i] is 1 for blocks closer than dist pixels to an active block
+	void band(const int dist, std::vector<unsigned char> &b) const
+	{
+		const int nd = (dist+bs-1)/bs;
+		b.assign(states.size(), 0);
+		for (int by = 0; by < nby; by++)
+			for (int bx = 0; bx < nbx; bx++)
+				if (is_active(bx, by))
+					for (int yn = std::max(by-nd, 0); yn <= std::min(by+nd, nby-1); yn++)
+						std::fill(b.begin() + (size_t)yn*nbx + std::max(bx-nd, 0),
+						          b.begin() + (size_t)yn*nbx + std::min(bx+nd, nbx-1) + 1, 1);
+	}
+
+	size_t count_active() const
+	{
+		return std::count(active.begin(), active.end(), 1);
+	}
+
+private:
+	int bs;
+	int nbx;
+	int nby;
+	std::vector<unsigned char> states;
+	std::vector<unsigned char> active;
+};
+
+#endif
@@ -0,0 +1,139 @@
+// per stage run time and memory statistics
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <ctime>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+// peak resident memory of the process in kB
+static long peak_rss_kb()
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0;
+	// kilobytes on Linux
+	return ru.ru_maxrss;
+}
+
+// CPU time of all threads of the process in seconds
+static double cpu_seconds()
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0.0;
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec)*1e-6;
+}
+
+static double wall_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+ * Statistics of named stages: wall and CPU time, growth of the peak
+ * resident memory and number of pixels processed.  begin() ends the
+ * running stage, stages with the same name (like in tiled processing)
+ * are accumulated.  A disabled profile does nothing.
+ */
+
+class Profile
+{
+public:
+	Profile(const bool enable = false): enabled(enable), current(-1)
+	{
+		wall0 = wall_seconds();
+		cpu0 = cpu_seconds();
+	}
+
+	bool is_enabled() const { return enabled; }
+
+	void begin(const char *name, const size_t pixels)
+	{
+		if (!enabled) return;
+		end();
+
+		current = -1;
+		for (size_t i = 0; i < stages.size(); i++)
+			if (stages[i].name == name)
+				current = i;
+		if (current < 0)
+		{
+			stages.push_back(Stage(name));
+			current = stages.size()-1;
+		}
+
+		Stage &s = stages[current];
+		s.calls++;
+		s.pixels += pixels;
+		start_wall = wall_seconds();
+		start_cpu = cpu_seconds();
+		start_rss = peak_rss_kb();
+	}
+
+	void end()
+	{
+		if (!enabled || (current < 0)) return;
+		Stage &s = stages[current];
+		s.wall += wall_seconds() - start_wall;
+		s.cpu += cpu_seconds() - start_cpu;
+		s.rss += peak_rss_kb() - start_rss;
+		current = -1;
+	}
+
+	// JSON report, info is inserted as additional members (without braces)
+	bool write_json(const char *filename, const std::string &info) const
+	{
+		FILE *f = std::fopen(filename, "w");
+		if (f == NULL) return false;
+
+		std::fprintf(f, "{\n");
+		if (!info.empty())
+			std::fprintf(f, "%s,\n", info.c_str());
+		std::fprintf(f, "  \"stages\": [\n");
+		for (size_t i = 0; i < stages.size(); i++)
+		{
+			const Stage &s = stages[i];
+			std::fprintf(f, "    { \"name\": \"%s\", \"calls\": %d, \"wall_s\": %.6f, \"cpu_s\": %.6f, \"peak_rss_delta_kb\": %ld, \"pixels\": %lu }%s\n",
+			             s.name.c_str(), s.calls, s.wall, s.cpu, s.rss, (unsigned long)s.pixels, (i+1 < stages.size()) ? "," : "");
+		}
+		std::fprintf(f, "  ],\n");
+		std::fprintf(f, "  \"total\": { \"wall_s\": %.6f, \"cpu_s\": %.6f, \"peak_rss_kb\": %ld }\n",
+		             wall_seconds() - wall0, cpu_seconds() - cpu0, peak_rss_kb());
+		std::fprintf(f, "}\n");
+
+		return (std::fclose(f) == 0);
+	}
+
+private:
+	struct Stage
+	{
+		std::string name;
+		int calls;
+		double wall;
+		double cpu;
+		long rss;
+		size_t pixels;
+
+		Stage(const char *n): name(n), calls(0), wall(0), cpu(0), rss(0), pixels(0) {}
+	};
+
+	bool enabled;
+	std::vector<Stage> stages;
+	int current;
+	double start_wall;
+	double start_cpu;
+	long start_rss;
+	double wall0;
+	double cpu0;
+};
+
+#endif
@@ -0,0 +1,99 @@
+// dependency graph of processing stages
+// Copyright 2013 Christoph Hormann <chris_hormann@gmx.de>
+// dual licensed CeCILL v2.0 and GPL v3
+
+#ifndef STAGES_H
+#define STAGES_H
+
+#include <vector>
+
+/*
+ * Runs processing stages in the order they are added, except that stages
+ * without dependency run concurrently as OpenMP tasks.  Every stage
+ * declares the resources (bits of up to 32 images or other data) it reads
+ * and writes, a stage depends on the earlier stages writing anything it
+ * reads or writes and on those reading anything it writes.  Within an
+ * active parallel region the stages run one after the other, parallel
+ * loops within concurrently running stages use a single thread.
+ */
+
+class StageGraph
+{
+public:
+	class Stage
+	{
+	public:
+		virtual ~Stage() {}
+		virtual void run() = 0;
+	};
+
+	// adds s reading the resources inputs and writing outputs, s is
+	// not owned by the graph
+	void add(Stage *s, const unsigned int inputs, const unsigned int outputs)
+	{
+		Node n;
+		n.stage = s;
+		n.inputs = inputs;
+		n.outputs = outputs;
+		n.waiting = 0;
+		nodes.push_back(n);
+
+		const int j = nodes.size()-1;
+		for (int i = 0; i < j; i++)
+			if ((nodes[i].outputs & (inputs | outputs)) || (nodes[i].inputs & outputs))
+			{
+				nodes[i].next.push_back(j);
+				nodes[j].waiting++;
+			}
+	}
+
+	// runs all stages and returns when they are finished
+	void run()
+	{
+		// the stages to start are collected first, the tasks already
+		// started change the waiting counts of their successors
+		std::vector<int> ready;
+		for (size_t i = 0; i < nodes.size(); i++)
+			if (nodes[i].waiting == 0)
+				ready.push_back(i);
+
+#pragma omp parallel if (nodes.size() > 1)
+#pragma omp single
+		{
+			for (size_t i = 0; i < ready.size(); i++)
+				start(ready[i]);
+		}
+		nodes.clear();
+	}
+
+private:
+	struct Node
+	{
+		Stage *stage;
+		unsigned int inputs;
+		unsigned int outputs;
+		int waiting;
+		std::vector<int> next;
+	};
+
+	std::vector<Node> nodes;
+
+	void start(const int i)
+	{
+#pragma omp task
+		{
+			nodes[i].stage->run();
+
+			std::vector<int> ready;
+#pragma omp critical(stage_graph)
+			for (size_t k = 0; k < nodes[i].next.size(); k++)
+				if (--nodes[nodes[i].next[k]].waiting == 0)
+					ready.push_back(nodes[i].next[k]);
+
+			for (size_t k = 0; k < ready.size(); k++)
+				start(ready[k]);
+		}
+	}
+};
+
+#endif